@@ -0,0 +1,384 @@
+/************************************************************************/
+/* File: ADCSampler.h													*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: ADCSampler.h implements the ADCSampler class, which		*/
+/*				owns the ADC multiplexer, schedules the analog inputs	*/
+/*				at their own rates, and queues the timestamped samples	*/
+/*				for their consumers										*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef ADCSAMPLER_H_
+#define ADCSAMPLER_H_
+
+#include <avr/io.h>
+#include "Global.h"
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Sample structure
+typedef struct T_Sample
+{
+	uint8_t Value;			//Upper 8 bits of the conversion (ADCH)
+	uint16_t Timestamp;		//Time of the conversion in ms
+}T_Sample;
+
+//Scheduled ADC input structure
+typedef struct T_ADCInput
+{
+	uint8_t Channel;		//ADC multiplexer channel
+	uint8_t Divider;		//Input is converted once every Divider scheduler rounds
+							//	(must be a power of 2)
+	uint8_t AverageShift;	//2^AverageShift conversions are averaged into each
+							//	queued sample
+}T_ADCInput;
+
+/************************************************************************/
+/* ADC Input Table														*/
+/************************************************************************/
+//Every analog input is listed here, indexed by its ADC_INPUT_* number.
+// Each input's ring buffer has exactly one consumer (the sorter lane for
+// the lane sensors); the latest sample may be read by anyone (the Timer 2
+// presence detector reads the lane sensors this way).
+//
+//The ADC free runs at 9.6k conversions/s, far more than a lane needs, so
+// the lanes average their conversions down to about 1.2k queued samples/s.
+// That keeps the ring buffers small enough to cover the longest main loop
+// pass.
+#if SORTER_LANES > 1
+#define LANE_AVERAGE_SHIFT 1	//2.4k conversions/s per lane once the mux switches
+#else
+#define LANE_AVERAGE_SHIFT 3	//9.6k conversions/s on the only lane
+#endif
+
+static const T_ADCInput ADCInputs[ADC_INPUTS] =
+{
+	{CHANNEL_0, 1, LANE_AVERAGE_SHIFT},	//ADC_INPUT_LANE_0
+#if SORTER_LANES > 1
+	{CHANNEL_1, 1, LANE_AVERAGE_SHIFT},	//ADC_INPUT_LANE_1
+#endif
+#ifdef ADC_SAMPLE_REFERENCE
+	{CHANNEL_BANDGAP, 64, 0},			//ADC_INPUT_REFERENCE
+#endif
+};
+
+/************************************************************************/
+/* SampleBuffer Class													*/
+/************************************************************************/
+//Single producer (ADC interrupt), single consumer (main loop) ring buffer.
+// Head is only written by the producer and Tail only by the consumer, and
+// both are single bytes, so no interrupt locking is needed.
+class SampleBuffer
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+	T_Sample Samples[SAMPLE_BUFFER_LEN];
+
+	volatile uint8_t Head;		//Next slot to write
+	volatile uint8_t Tail;		//Next slot to read
+
+	public :
+
+	/************************************************************************/
+	/* Public Members														*/
+	/************************************************************************/
+	volatile uint8_t Overruns;	//Number of samples dropped because the buffer was full
+								//	(stops at 255)
+
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Default Constructor													*/
+	/************************************************************************/
+	SampleBuffer()
+	{
+		this->Head = 0;
+		this->Tail = 0;
+		this->Overruns = 0;
+	}
+
+	/************************************************************************/
+	/* Push a sample (producer side)										*/
+	/************************************************************************/
+	bool Push(uint8_t value, uint16_t timestamp)
+	{
+		uint8_t head = this->Head;
+		uint8_t next = (head + 1) & (SAMPLE_BUFFER_LEN - 1);
+
+		//Drop the newest sample if the consumer has fallen behind
+		if(next == this->Tail)
+		{
+			if(this->Overruns < 0xFF)
+			{
+				this->Overruns++;
+			}
+			return false;
+		}
+
+		this->Samples[head].Value = value;
+		this->Samples[head].Timestamp = timestamp;
+
+		//Publish the sample only once it is complete
+		this->Head = next;
+
+		return true;
+	}
+
+	/************************************************************************/
+	/* Pop a sample (consumer side)											*/
+	/************************************************************************/
+	bool Pop(T_Sample &sample)
+	{
+		uint8_t tail = this->Tail;
+
+		if(tail == this->Head)
+		{
+			return false;
+		}
+
+		sample.Value = this->Samples[tail].Value;
+		sample.Timestamp = this->Samples[tail].Timestamp;
+
+		this->Tail = (tail + 1) & (SAMPLE_BUFFER_LEN - 1);
+
+		return true;
+	}
+};
+
+/************************************************************************/
+/* ADCSampler Class														*/
+/************************************************************************/
+//The sampler is the only code that touches ADMUX or starts conversions.
+// One scheduler round visits every input in table order and converts the
+// inputs whose divider is due; an input that needs a mux switch costs one
+// extra (discarded) conversion while the sample-and-hold settles.
+class ADCSampler
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+	SampleBuffer Buffers[ADC_INPUTS];		//Samples waiting for each input
+	
+	volatile uint8_t Latest[ADC_INPUTS];	//Most recent sample on each input
+	
+	uint16_t Sum[ADC_INPUTS];				//Conversions being averaged on each input
+	uint8_t Summed[ADC_INPUTS];				//Number of conversions in Sum
+	
+	uint8_t Countdown[ADC_INPUTS];			//Rounds until each input is due
+	
+	uint16_t SampleRate[ADC_INPUTS];		//Samples per second for each input
+	
+	uint8_t Input;							//Input currently being converted
+	bool Discard;							//Discard the next conversion (mux just switched)
+	
+	volatile uint16_t Milliseconds;			//Timestamp source
+	
+	/************************************************************************/
+	/* Private Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Select the input's channel and start a conversion					*/
+	/************************************************************************/
+	void StartConversion(void)
+	{
+		//Clear the old channel bits before setting the new ones
+		ADMUX = _BV(REFS0) | _BV(ADLAR) | (ADCInputs[this->Input].Channel & 0x0F);
+		ADCSRA |= _BV(ADSC);
+	}
+	
+	/************************************************************************/
+	/* Move to the next input that is due									*/
+	/************************************************************************/
+	void NextInput(void)
+	{
+#if ADC_INPUTS > 1
+		uint8_t channel = ADCInputs[this->Input].Channel;
+		
+		//Input 0 has a divider of 1, so this always finds an input
+		do
+		{
+			if(++this->Input >= ADC_INPUTS)
+			{
+				this->Input = 0;
+			}
+			
+			if(this->Countdown[this->Input] > 0)
+			{
+				this->Countdown[this->Input]--;
+			}
+			else
+			{
+				this->Countdown[this->Input] = ADCInputs[this->Input].Divider - 1;
+				break;
+			}
+		}while(true);
+		
+		//Let the sample-and-hold settle after a mux switch
+		this->Discard = (ADCInputs[this->Input].Channel != channel);
+#endif
+	}
+	
+	/************************************************************************/
+	/* Work out the sample rate each input gets from the schedule			*/
+	/************************************************************************/
+	void ComputeSampleRates(void)
+	{
+		uint8_t period = 1;
+		uint16_t conversions = 0;
+		
+		//The schedule repeats every largest-divider rounds
+		for(int i = 0; i < ADC_INPUTS; i++)
+		{
+			if(ADCInputs[i].Divider > period)
+			{
+				period = ADCInputs[i].Divider;
+			}
+		}
+		
+		//Walk one full period of the schedule and count the conversions,
+		// including the discarded ones after each mux switch
+		uint8_t channel = ADCInputs[ADC_INPUTS - 1].Channel;
+		
+		for(uint8_t round = 0; round < period; round++)
+		{
+			for(int i = 0; i < ADC_INPUTS; i++)
+			{
+				if((round & (ADCInputs[i].Divider - 1)) == 0)
+				{
+					conversions += (ADCInputs[i].Channel != channel) ? 2 : 1;
+					channel = ADCInputs[i].Channel;
+				}
+			}
+		}
+		
+		for(int i = 0; i < ADC_INPUTS; i++)
+		{
+			this->SampleRate[i] = (((uint32_t)ADC_CONVERSION_RATE * (period / ADCInputs[i].Divider)) / conversions) >> ADCInputs[i].AverageShift;
+		}
+	}
+	
+	public :
+	
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Default Constructor													*/
+	/************************************************************************/
+	ADCSampler()
+	{
+		this->Input = 0;
+		this->Discard = true;
+		this->Milliseconds = 0;
+		
+		for(int i = 0; i < ADC_INPUTS; i++)
+		{
+			//Read as no marble until the first sample arrives
+			this->Latest[i] = 0xFF;
+			this->Countdown[i] = 0;
+			this->Sum[i] = 0;
+			this->Summed[i] = 0;
+		}
+		
+		ComputeSampleRates();
+	}
+	
+	/************************************************************************/
+	/* Default Destructor													*/
+	/************************************************************************/
+	~ADCSampler()
+	{
+		/* */
+	}
+	
+	/************************************************************************/
+	/* Start sampling (ADC must be enabled with its interrupt)				*/
+	/************************************************************************/
+	void Start(void)
+	{
+		this->Input = 0;
+		this->Discard = true;
+		
+		StartConversion();
+	}
+	
+	/************************************************************************/
+	/* Advance the timestamp (called every 1ms from Timer 2)				*/
+	/************************************************************************/
+	void Tick(void)
+	{
+		this->Milliseconds++;
+	}
+	
+	/************************************************************************/
+	/* Handle a completed conversion (called from ADC_vect)					*/
+	/************************************************************************/
+	void OnConversionComplete(void)
+	{
+		uint8_t value = ADCH;
+		
+		//The first conversion after a mux switch has not settled
+		if(this->Discard)
+		{
+			this->Discard = false;
+			ADCSRA |= _BV(ADSC);
+			return;
+		}
+		
+		uint8_t input = this->Input;
+		
+		this->Latest[input] = value;
+		this->Sum[input] += value;
+		
+		//Queue the average once enough conversions are in
+		if(++this->Summed[input] >= (1 << ADCInputs[input].AverageShift))
+		{
+			this->Buffers[input].Push(this->Sum[input] >> ADCInputs[input].AverageShift, this->Milliseconds);
+			this->Sum[input] = 0;
+			this->Summed[input] = 0;
+		}
+		
+		NextInput();
+		StartConversion();
+	}
+	
+	/************************************************************************/
+	/* Get the next queued sample on an input								*/
+	/************************************************************************/
+	bool GetSample(int input, T_Sample &sample)
+	{
+		return this->Buffers[input].Pop(sample);
+	}
+	
+	/************************************************************************/
+	/* Get the most recent sample on an input								*/
+	/************************************************************************/
+	uint8_t GetLatest(int input)
+	{
+		return this->Latest[input];
+	}
+	
+	/************************************************************************/
+	/* Get the number of samples per second the schedule gives an input		*/
+	/************************************************************************/
+	uint16_t GetSampleRate(int input)
+	{
+		return this->SampleRate[input];
+	}
+	
+	/************************************************************************/
+	/* Get the number of samples an input has dropped						*/
+	/************************************************************************/
+	uint8_t GetOverruns(int input)
+	{
+		return this->Buffers[input].Overruns;
+	}
+};
+
+#endif /* ADCSAMPLER_H_ */
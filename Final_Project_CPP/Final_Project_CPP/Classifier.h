@@ -0,0 +1,85 @@
+/************************************************************************/
+/* File: Classifier.h													*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: Classifier.h builds the 256 entry sample to marble type	*/
+/*				lookup table in flash at compile time from the list of	*/
+/*				marble class ranges										*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef CLASSIFIER_H_
+#define CLASSIFIER_H_
+
+#include <avr/pgmspace.h>
+#include "Global.h"
+#include "Marble.h"
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Marble class range structure
+typedef struct T_ClassRange
+{
+	uint8_t Low;			//Lowest sample value in the class
+	uint8_t High;			//Highest sample value in the class
+	T_MarbleType Type;		//Marble type for the range
+}T_ClassRange;
+
+/************************************************************************/
+/* Marble Class Ranges													*/
+/************************************************************************/
+//Sample values covered by no range are hysteresis bands: a sample in a
+// band keeps whatever the marble was last classified as. Ranges must be
+// in ascending order and must not overlap. To add a marble colour, add
+// its T_MarbleType and a range here.
+static constexpr T_ClassRange MarbleClasses[] =
+{
+	{0,												WHITE_THRESHOLD,	White},
+	{WHITE_THRESHOLD + 1 + CLASS_HYSTERESIS,		BLACK_THRESHOLD,	Black},
+	{BLACK_THRESHOLD + 1 + CLASS_HYSTERESIS,		255,				NoMarble},
+};
+
+#define NUM_MARBLE_CLASSES (sizeof(MarbleClasses) / sizeof(MarbleClasses[0]))
+
+/************************************************************************/
+/* Compile Time Table Generation										*/
+/************************************************************************/
+//Marble type for a sample value, searching the ranges from index i
+constexpr uint8_t ClassOf(unsigned value, unsigned i = 0)
+{
+	return (i >= NUM_MARBLE_CLASSES) ? MARBLE_CLASS_HOLD :
+		((value >= MarbleClasses[i].Low) && (value <= MarbleClasses[i].High)) ? (uint8_t)MarbleClasses[i].Type :
+		ClassOf(value, i + 1);
+}
+
+//Whether the ranges from index i on are ascending and do not overlap
+constexpr bool ClassRangesValid(unsigned i = 0)
+{
+	return (i >= NUM_MARBLE_CLASSES) ? true :
+		(MarbleClasses[i].Low > MarbleClasses[i].High) ? false :
+		((i > 0) && (MarbleClasses[i].Low <= MarbleClasses[i - 1].High)) ? false :
+		ClassRangesValid(i + 1);
+}
+
+static_assert(ClassRangesValid(), "Marble class ranges must be ascending and must not overlap");
+
+#define CLASS_LUT_4(i)		ClassOf(i), ClassOf((i) + 1), ClassOf((i) + 2), ClassOf((i) + 3)
+#define CLASS_LUT_16(i)		CLASS_LUT_4(i), CLASS_LUT_4((i) + 4), CLASS_LUT_4((i) + 8), CLASS_LUT_4((i) + 12)
+#define CLASS_LUT_64(i)		CLASS_LUT_16(i), CLASS_LUT_16((i) + 16), CLASS_LUT_16((i) + 32), CLASS_LUT_16((i) + 48)
+#define CLASS_LUT_256		CLASS_LUT_64(0), CLASS_LUT_64(64), CLASS_LUT_64(128), CLASS_LUT_64(192)
+
+//Sample value to marble type (or MARBLE_CLASS_HOLD) lookup table
+static const uint8_t MarbleClassTable[256] PROGMEM = { CLASS_LUT_256 };
+
+/************************************************************************/
+/* Look up the marble class of a sample									*/
+/************************************************************************/
+static inline uint8_t LookUpMarbleClass(uint8_t value)
+{
+	return pgm_read_byte(&MarbleClassTable[value]);
+}
+
+#endif /* CLASSIFIER_H_ */
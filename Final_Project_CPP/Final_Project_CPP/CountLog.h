@@ -0,0 +1,187 @@
+/************************************************************************/
+/* File: CountLog.h														*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: CountLog.h implements the CountLog class, a wear		*/
+/*				leveled, append only log of the marble counts and sort	*/
+/*				time spread across the EEPROM							*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef COUNTLOG_H_
+#define COUNTLOG_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <util/crc16.h>
+#include "Global.h"
+#include "EEPROMWriter.h"
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Count record structure (one log slot)
+typedef struct T_CountRecord
+{
+	uint16_t Sequence;		//Record sequence number (0xFFFF is never written)
+	uint8_t Version;		//Record layout version (COUNT_RECORD_VERSION)
+	uint8_t State;			//Sorter state to resume in (T_State)
+	uint32_t BlackCount;	//Black marbles sorted
+	uint32_t WhiteCount;	//White marbles sorted
+	uint32_t RunTime;		//Time spent sorting in ms
+	uint16_t Crc;			//CRC-16 (CCITT) of the fields above (written last)
+}T_CountRecord;
+
+#define COUNT_LOG_SLOTS ((COUNT_LOG_END_ADDR - COUNT_LOG_START_ADDR) / sizeof(T_CountRecord))
+
+static_assert(sizeof(T_CountRecord) < EEPROM_QUEUE_LEN, "The EEPROM writer queue must hold a whole count record");
+
+/************************************************************************/
+/* CountLog Class														*/
+/************************************************************************/
+//Every update is appended to the slot after the newest record, so each
+// EEPROM cell is written once per COUNT_LOG_SLOTS updates instead of once
+// per update. The slot overwritten is always the oldest, so the log is a
+// COUNT_LOG_SLOTS deep double buffer: a write torn by a power loss fails
+// its CRC and the previous record is still found. At boot the newest
+// record is the valid one of the current version with the highest
+// sequence number (compared with wraparound).
+class CountLog
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+	T_CountRecord Newest;			//Copy of the newest record
+	uint16_t NewestSlot;			//Slot holding the newest record
+	bool Valid;						//Whether the log holds any valid record
+
+	/************************************************************************/
+	/* Private Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* CRC-16 of a record, excluding the CRC field							*/
+	/************************************************************************/
+	static uint16_t Crc(const T_CountRecord &record)
+	{
+		const uint8_t *bytes = (const uint8_t *)&record;
+		uint16_t crc = 0xFFFF;
+
+		for(uint8_t i = 0; i < offsetof(T_CountRecord, Crc); i++)
+		{
+			crc = _crc_ccitt_update(crc, bytes[i]);
+		}
+
+		return crc;
+	}
+
+	/************************************************************************/
+	/* EEPROM address of a slot												*/
+	/************************************************************************/
+	static uint16_t SlotAddress(uint16_t slot)
+	{
+		return COUNT_LOG_START_ADDR + (slot * sizeof(T_CountRecord));
+	}
+
+	public :
+
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Default Constructor													*/
+	/************************************************************************/
+	CountLog()
+	{
+		memset(&this->Newest, 0, sizeof(this->Newest));
+
+		//The first record appended gets sequence 0 in slot 0
+		this->Newest.Sequence = 0xFFFF;
+		this->NewestSlot = COUNT_LOG_SLOTS - 1;
+		this->Valid = false;
+	}
+
+	/************************************************************************/
+	/* Find the newest valid record in the EEPROM							*/
+	/************************************************************************/
+	void Open(void)
+	{
+		T_CountRecord record;
+
+		this->Valid = false;
+
+		for(uint16_t slot = 0; slot < COUNT_LOG_SLOTS; slot++)
+		{
+			eepromWriter.ReadBlock(SlotAddress(slot), &record, sizeof(record));
+
+			//Skip erased slots, torn slots, and older record layouts
+			if((record.Sequence == 0xFFFF) || (record.Version != COUNT_RECORD_VERSION) || (record.Crc != Crc(record)))
+			{
+				continue;
+			}
+
+			if(!this->Valid || ((int16_t)(record.Sequence - this->Newest.Sequence) > 0))
+			{
+				this->Newest = record;
+				this->NewestSlot = slot;
+				this->Valid = true;
+			}
+		}
+	}
+
+	/************************************************************************/
+	/* Get the newest record, returns false if the log is empty				*/
+	/************************************************************************/
+	bool GetNewest(T_CountRecord &record)
+	{
+		record = this->Newest;
+
+		return this->Valid;
+	}
+
+	/************************************************************************/
+	/* Queue a record after the newest one, returns false if the EEPROM		*/
+	/* writer has no room for it											*/
+	/************************************************************************/
+	bool Append(uint8_t state, uint32_t blackCount, uint32_t whiteCount, uint32_t runTime)
+	{
+		T_CountRecord record;
+
+		record.Sequence = this->Newest.Sequence + 1;
+
+		//0xFFFF reads the same as an erased slot
+		if(record.Sequence == 0xFFFF)
+		{
+			record.Sequence = 0;
+		}
+
+		record.Version = COUNT_RECORD_VERSION;
+		record.State = state;
+		record.BlackCount = blackCount;
+		record.WhiteCount = whiteCount;
+		record.RunTime = runTime;
+		record.Crc = Crc(record);
+
+		uint16_t slot = this->NewestSlot + 1;
+
+		if(slot >= COUNT_LOG_SLOTS)
+		{
+			slot = 0;
+		}
+
+		//The CRC is the last byte queued, so it is the last one programmed
+		if(!eepromWriter.WriteBlock(SlotAddress(slot), &record, sizeof(record)))
+		{
+			return false;
+		}
+
+		this->Newest = record;
+		this->NewestSlot = slot;
+		this->Valid = true;
+
+		return true;
+	}
+};
+
+#endif /* COUNTLOG_H_ */
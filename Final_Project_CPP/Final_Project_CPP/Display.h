@@ -0,0 +1,353 @@
+/************************************************************************/
+/* File: Display.h														*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: Display.h implements the Display class, a RAM copy of	*/
+/*				the LCD that is drawn into freely and sent to the LCD	*/
+/*				one changed character at a time							*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef DISPLAY_H_
+#define DISPLAY_H_
+
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <LiquidCrystal_I2C.h>
+#include "Global.h"
+
+#define DISPLAY_CLEAR_CELLS	20		//Changed cells at which clearing the LCD beats writing spaces
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Number field alignment
+typedef enum T_Align
+{
+	AlignRight,				//Fill before the digits
+	AlignLeft				//Spaces after the digits
+}T_Align;
+
+//Text at a fixed place on a screen (kept in flash)
+typedef struct T_ScreenText
+{
+	uint8_t Column;			//Column of the first character
+	uint8_t Line;			//Line
+	const char *Text;		//Text in flash, NULL ends a screen
+}T_ScreenText;
+
+#define SCREEN_END { 0, 0, NULL }
+
+/************************************************************************/
+/* Display Class														*/
+/************************************************************************/
+//Frame holds what the screen should show and Shown what the LCD shows.
+// Drawing only touches Frame; Render sends the cells that differ, moving
+// the LCD cursor only when the next changed cell is not where the LCD's
+// own auto increment leaves it.
+class Display
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+	LiquidCrystal_I2C &Lcd;				//LCD the frame is rendered to
+
+	char Frame[NUM_LINES][LINE_LEN];	//Screen being drawn
+	char Shown[NUM_LINES][LINE_LEN];	//Screen on the LCD
+
+	uint8_t Column;						//Drawing cursor column
+	uint8_t Line;						//Drawing cursor line
+
+	/************************************************************************/
+	/* Private Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Check if the frame is blank											*/
+	/************************************************************************/
+	bool IsBlank(void)
+	{
+		for(uint8_t line = 0; line < NUM_LINES; line++)
+		{
+			for(uint8_t column = 0; column < LINE_LEN; column++)
+			{
+				if(this->Frame[line][column] != ' ')
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/************************************************************************/
+	/* Decimal digits of a value, least significant first, returns the		*/
+	/* number of digits														*/
+	/************************************************************************/
+	static uint8_t Digits(uint32_t value, char *digits)
+	{
+		uint8_t count = 0;
+
+		//32 bit division is several times slower, so drop to 16 bits as
+		// soon as the value fits
+		while(value > 0xFFFF)
+		{
+			digits[count++] = '0' + (value % 10);
+			value /= 10;
+		}
+
+		uint16_t low = value;
+
+		do
+		{
+			digits[count++] = '0' + (low % 10);
+			low /= 10;
+		}while(low);
+
+		return count;
+	}
+
+	public :
+
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Constructor with LCD													*/
+	/************************************************************************/
+	Display(LiquidCrystal_I2C &lcd) : Lcd(lcd)
+	{
+		memset(this->Frame, ' ', sizeof(this->Frame));
+		memset(this->Shown, ' ', sizeof(this->Shown));
+
+		this->Column = 0;
+		this->Line = 0;
+	}
+
+	/************************************************************************/
+	/* Blank the frame and home the cursor									*/
+	/************************************************************************/
+	void Clear(void)
+	{
+		memset(this->Frame, ' ', sizeof(this->Frame));
+
+		Home();
+	}
+
+	/************************************************************************/
+	/* Move the cursor to the top left										*/
+	/************************************************************************/
+	void Home(void)
+	{
+		SetCursor(0, LINE_1);
+	}
+
+	/************************************************************************/
+	/* Move the cursor														*/
+	/************************************************************************/
+	void SetCursor(uint8_t column, uint8_t line)
+	{
+		this->Column = column;
+		this->Line = line;
+	}
+
+	/************************************************************************/
+	/* Draw a character at the cursor (clipped at the end of the line)		*/
+	/************************************************************************/
+	void Write(char c)
+	{
+		if((this->Line < NUM_LINES) && (this->Column < LINE_LEN))
+		{
+			this->Frame[this->Line][this->Column] = c;
+		}
+
+		this->Column++;
+	}
+
+	/************************************************************************/
+	/* Draw a string at the cursor											*/
+	/************************************************************************/
+	void Print(const char *text)
+	{
+		while(*text)
+		{
+			Write(*text++);
+		}
+	}
+
+	/************************************************************************/
+	/* Draw a string kept in flash at the cursor							*/
+	/************************************************************************/
+	void Print_P(const char *text)
+	{
+		char c;
+
+		while((c = pgm_read_byte(text++)))
+		{
+			Write(c);
+		}
+	}
+
+	/************************************************************************/
+	/* Blank the frame and draw a screen kept in flash (a T_ScreenText		*/
+	/* array ending with SCREEN_END)										*/
+	/************************************************************************/
+	void PrintScreen_P(const T_ScreenText *screen)
+	{
+		Clear();
+
+		for(;; screen++)
+		{
+			const char *text = (const char *)pgm_read_word(&screen->Text);
+
+			if(text == NULL)
+			{
+				break;
+			}
+
+			SetCursor(pgm_read_byte(&screen->Column), pgm_read_byte(&screen->Line));
+			Print_P(text);
+		}
+
+		Home();
+	}
+
+	/************************************************************************/
+	/* Draw an unsigned number at least Width characters wide (a value with	*/
+	/* more digits is drawn whole). Right aligned numbers are padded with	*/
+	/* Fill, left aligned ones with spaces, so PrintNumber<5>(x) draws the	*/
+	/* same as sprintf's "%05lu" and PrintNumber<5, ' ', AlignLeft>(x) the	*/
+	/* same as "%-5lu"														*/
+	/************************************************************************/
+	template<uint8_t Width, char Fill = '0', T_Align Align = AlignRight>
+	void PrintNumber(uint32_t value)
+	{
+		char digits[10];
+		uint8_t count = Digits(value, digits);
+
+		if(Align == AlignRight)
+		{
+			for(uint8_t i = count; i < Width; i++)
+			{
+				Write(Fill);
+			}
+		}
+
+		for(uint8_t i = count; i > 0; i--)
+		{
+			Write(digits[i - 1]);
+		}
+
+		if(Align == AlignLeft)
+		{
+			for(uint8_t i = count; i < Width; i++)
+			{
+				Write(' ');
+			}
+		}
+	}
+
+	/************************************************************************/
+	/* Draw a signed number right aligned in at least Width characters,		*/
+	/* padded with spaces (sprintf's "%4d" is PrintSigned<4>(x))			*/
+	/************************************************************************/
+	template<uint8_t Width>
+	void PrintSigned(int16_t value)
+	{
+		char digits[10];
+		uint8_t count = Digits((value < 0) ? -(int32_t)value : value, digits);
+
+		if(value < 0)
+		{
+			digits[count++] = '-';
+		}
+
+		for(uint8_t i = count; i < Width; i++)
+		{
+			Write(' ');
+		}
+
+		for(uint8_t i = count; i > 0; i--)
+		{
+			Write(digits[i - 1]);
+		}
+	}
+
+	/************************************************************************/
+	/* Send the changed cells to the LCD, at most budget of them, returns	*/
+	/* the number sent														*/
+	/************************************************************************/
+	//A partial render leaves the rest for the next call. Drawing over a
+	// frame that is still being sent just replaces the cells not sent yet,
+	// so a slow LCD drops frames instead of falling behind.
+	//
+	//Cells go out through LiquidCrystal_I2C, which waits on Wire for every
+	// byte and has no bus timeout, so the budget is what bounds a render.
+	// The queued TWI driver (twiqueue) is only used by the LCD_I2C test
+	// project so far.
+	uint8_t Render(uint8_t budget = NUM_LINES * LINE_LEN)
+	{
+		uint8_t changed = 0;
+
+		for(uint8_t line = 0; line < NUM_LINES; line++)
+		{
+			for(uint8_t column = 0; column < LINE_LEN; column++)
+			{
+				changed += (this->Frame[line][column] != this->Shown[line][column]);
+			}
+		}
+
+		if((changed == 0) || (budget == 0))
+		{
+			return 0;
+		}
+
+		//One clear command is cheaper than writing a screenful of spaces
+		if((changed >= DISPLAY_CLEAR_CELLS) && IsBlank())
+		{
+			this->Lcd.clear();
+			memset(this->Shown, ' ', sizeof(this->Shown));
+
+			return changed;
+		}
+
+		uint8_t sent = 0;
+
+		for(uint8_t line = 0; (line < NUM_LINES) && (sent < budget); line++)
+		{
+			//The LCD cursor is unknown at the start of each line
+			uint8_t lcdColumn = LINE_LEN;
+
+			for(uint8_t column = 0; column < LINE_LEN; column++)
+			{
+				char c = this->Frame[line][column];
+
+				if(c == this->Shown[line][column])
+				{
+					continue;
+				}
+
+				if(lcdColumn != column)
+				{
+					this->Lcd.setCursor(column, line);
+				}
+
+				this->Lcd.write(c);
+				this->Shown[line][column] = c;
+
+				lcdColumn = column + 1;
+
+				if(++sent >= budget)
+				{
+					break;
+				}
+			}
+		}
+
+		return sent;
+	}
+};
+
+#endif /* DISPLAY_H_ */
@@ -0,0 +1,188 @@
+/************************************************************************/
+/* File: EEPROMWriter.h													*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: EEPROMWriter.h implements the EEPROMWriter class, which	*/
+/*				queues EEPROM writes and programs them one byte at a	*/
+/*				time from the EEPROM ready interrupt					*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef EEPROMWRITER_H_
+#define EEPROMWRITER_H_
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "Global.h"
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Queued EEPROM write structure
+typedef struct T_EEPROMWrite
+{
+	uint16_t Address;		//EEPROM address
+	uint8_t Value;			//Value to program
+}T_EEPROMWrite;
+
+/************************************************************************/
+/* EEPROMWriter Class													*/
+/************************************************************************/
+//Single producer (main loop), single consumer (EE_READY_vect) queue of
+// byte writes, locked the same way as SampleBuffer. Writes are programmed
+// in the order they were queued, and a byte that already holds its value
+// is skipped without programming. Nothing ever waits on the 3.4ms a cell
+// takes to program.
+//
+//The EEPROM address register is shared, so once writes have been queued
+// the EEPROM must only be read through ReadBlock.
+class EEPROMWriter
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+	T_EEPROMWrite Queue[EEPROM_QUEUE_LEN];
+
+	volatile uint8_t Head;		//Next entry to write
+	volatile uint8_t Tail;		//Next entry to program
+
+	public :
+
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Default Constructor													*/
+	/************************************************************************/
+	EEPROMWriter()
+	{
+		this->Head = 0;
+		this->Tail = 0;
+	}
+
+	/************************************************************************/
+	/* Queue a block of bytes, returns false (queuing nothing) if full		*/
+	/************************************************************************/
+	bool WriteBlock(uint16_t address, const void *data, uint8_t length)
+	{
+		const uint8_t *bytes = (const uint8_t *)data;
+		uint8_t head = this->Head;
+
+		if(length > Free())
+		{
+			return false;
+		}
+
+		for(uint8_t i = 0; i < length; i++)
+		{
+			this->Queue[head].Address = address + i;
+			this->Queue[head].Value = bytes[i];
+			head = (head + 1) & (EEPROM_QUEUE_LEN - 1);
+		}
+
+		//Publish the block only once it is complete, then let the
+		// interrupt drain it
+		this->Head = head;
+		EECR |= _BV(EERIE);
+
+		return true;
+	}
+
+	/************************************************************************/
+	/* Read a block of bytes (waits for a byte being programmed)			*/
+	/************************************************************************/
+	//The wait for a byte being programmed (up to 3.4ms) is made with
+	// interrupts on; only the read itself is atomic, and it is retried if
+	// EE_READY_vect started programming the next byte in between.
+	void ReadBlock(uint16_t address, void *data, uint8_t length)
+	{
+		uint8_t *bytes = (uint8_t *)data;
+
+		for(uint8_t i = 0; i < length; i++)
+		{
+			bool done = false;
+
+			while(!done)
+			{
+				while(EECR & _BV(EEPE));
+
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					if(!(EECR & _BV(EEPE)))
+					{
+						EEAR = address + i;
+						EECR |= _BV(EERE);
+						bytes[i] = EEDR;
+						done = true;
+					}
+				}
+			}
+		}
+	}
+
+	/************************************************************************/
+	/* Number of bytes that can be queued									*/
+	/************************************************************************/
+	uint8_t Free(void)
+	{
+		return (EEPROM_QUEUE_LEN - 1) - ((this->Head - this->Tail) & (EEPROM_QUEUE_LEN - 1));
+	}
+
+	/************************************************************************/
+	/* Check if every queued byte has been programmed						*/
+	/************************************************************************/
+	bool IsIdle(void)
+	{
+		return (this->Head == this->Tail) && !(EECR & _BV(EEPE));
+	}
+
+	/************************************************************************/
+	/* Program the next changed byte (called from EE_READY_vect)			*/
+	/************************************************************************/
+	//Skipping unchanged bytes stops after EEPROM_READY_SCAN of them, so one
+	// call stays short. EE_READY_vect fires again at once while EERIE is
+	// set and nothing is being programmed, so the scan carries on from there
+	// after any other pending interrupt has run.
+	void OnReady(void)
+	{
+		uint8_t tail = this->Tail;
+		uint8_t scanned = 0;
+
+		while((tail != this->Head) && (scanned++ < EEPROM_READY_SCAN))
+		{
+			T_EEPROMWrite &write = this->Queue[tail];
+
+			tail = (tail + 1) & (EEPROM_QUEUE_LEN - 1);
+
+			EEAR = write.Address;
+			EECR |= _BV(EERE);
+
+			if(EEDR != write.Value)
+			{
+				EEDR = write.Value;
+
+				//Erase and write; EEPE must be set within 4 cycles of EEMPE
+				EECR = _BV(EERIE) | _BV(EEMPE);
+				EECR |= _BV(EEPE);
+
+				this->Tail = tail;
+				return;
+			}
+		}
+
+		this->Tail = tail;
+
+		//Queue drained
+		if(tail == this->Head)
+		{
+			EECR &= ~_BV(EERIE);
+		}
+	}
+};
+
+//The EEPROM writer instance (defined in main.cpp)
+extern EEPROMWriter eepromWriter;
+
+#endif /* EEPROMWRITER_H_ */
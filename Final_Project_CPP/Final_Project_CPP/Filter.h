@@ -0,0 +1,228 @@
+/************************************************************************/
+/* File: Filter.h														*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: Filter.h implements the SampleFilter class, an integer	*/
+/*				only filter between the raw sensor samples and the		*/
+/*				marble classification. It has no AVR dependencies so	*/
+/*				it can also be built and benchmarked on a host PC		*/
+/*				(see Test/FilterTest.cpp)								*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stdint.h>
+
+//Filter Definitions (may be set by the build)
+#define FILTER_BOXCAR		0		//Moving average over the last FILTER_WINDOW_LEN outputs
+#define FILTER_EMA			1		//Exponential moving average with weight 1/2^FILTER_EMA_SHIFT
+
+#ifndef FILTER_MEDIAN3
+#define FILTER_MEDIAN3		1		//Median-of-3 spike rejection on the raw samples (0 or 1)
+#endif
+
+#ifndef FILTER_OVERSAMPLE
+#define FILTER_OVERSAMPLE	4		//Raw samples averaged per decimated output (power of 2, <= 128)
+#endif
+
+#ifndef FILTER_MODE
+#define FILTER_MODE			FILTER_EMA
+#endif
+
+#ifndef FILTER_WINDOW_LEN
+#define FILTER_WINDOW_LEN	4		//Boxcar window length (power of 2, <= 128)
+#endif
+
+#ifndef FILTER_EMA_SHIFT
+#define FILTER_EMA_SHIFT	1		//EMA weight shift (0 disables the average)
+#endif
+
+/************************************************************************/
+/* SampleFilter Class													*/
+/************************************************************************/
+class SampleFilter
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+#if FILTER_MEDIAN3
+	uint8_t History[2];				//Previous two raw samples
+#endif
+
+	uint16_t Accumulator;			//Sum of the raw samples being decimated
+	uint8_t AccumulatorCount;		//Number of raw samples in the accumulator
+
+#if FILTER_MODE == FILTER_BOXCAR
+	uint8_t Window[FILTER_WINDOW_LEN];	//Last decimated values
+	uint8_t WindowIndex;				//Oldest value in the window
+	uint16_t WindowSum;					//Sum of the window
+#else
+	int16_t Average;				//Average in 8.7 fixed point (fits int16 math)
+#endif
+
+	uint8_t Output;					//Latest filtered value
+	bool Primed;					//Whether the filter has seen a sample since reset
+
+	/************************************************************************/
+	/* Private Methods														*/
+	/************************************************************************/
+#if FILTER_MEDIAN3
+	/************************************************************************/
+	/* Median of the new sample and the previous two						*/
+	/************************************************************************/
+	uint8_t Median(uint8_t sample)
+	{
+		uint8_t a = this->History[0];
+		uint8_t b = this->History[1];
+		uint8_t median;
+
+		this->History[0] = b;
+		this->History[1] = sample;
+
+		if(a > b)
+		{
+			uint8_t tmp = a;
+			a = b;
+			b = tmp;
+		}
+
+		//a <= b, so the median is the sample clamped to [a, b]
+		if(sample < a)
+		{
+			median = a;
+		}
+		else if(sample > b)
+		{
+			median = b;
+		}
+		else
+		{
+			median = sample;
+		}
+
+		return median;
+	}
+#endif
+
+	/************************************************************************/
+	/* Average a decimated value into the output							*/
+	/************************************************************************/
+	uint8_t Smooth(uint8_t value)
+	{
+#if FILTER_MODE == FILTER_BOXCAR
+		this->WindowSum += value - this->Window[this->WindowIndex];
+		this->Window[this->WindowIndex] = value;
+		this->WindowIndex = (this->WindowIndex + 1) & (FILTER_WINDOW_LEN - 1);
+
+		return this->WindowSum / FILTER_WINDOW_LEN;
+#else
+		//Average += (value - Average) / 2^shift
+		int16_t error = ((int16_t)value << 7) - this->Average;
+
+		this->Average += error >> FILTER_EMA_SHIFT;
+
+		//Round to the nearest whole value
+		return (uint8_t)((this->Average + 0x40) >> 7);
+#endif
+	}
+
+	/************************************************************************/
+	/* Fill the filter state with a value									*/
+	/************************************************************************/
+	void Prime(uint8_t value)
+	{
+#if FILTER_MEDIAN3
+		this->History[0] = value;
+		this->History[1] = value;
+#endif
+
+#if FILTER_MODE == FILTER_BOXCAR
+		for(uint8_t i = 0; i < FILTER_WINDOW_LEN; i++)
+		{
+			this->Window[i] = value;
+		}
+
+		this->WindowSum = (uint16_t)value * FILTER_WINDOW_LEN;
+		this->WindowIndex = 0;
+#else
+		this->Average = (int16_t)value << 7;
+#endif
+
+		this->Output = value;
+		this->Primed = true;
+	}
+
+	public :
+
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Default Constructor													*/
+	/************************************************************************/
+	SampleFilter()
+	{
+		Reset();
+	}
+
+	/************************************************************************/
+	/* Clear the filter state												*/
+	/************************************************************************/
+	void Reset(void)
+	{
+		this->Accumulator = 0;
+		this->AccumulatorCount = 0;
+		this->Primed = false;
+
+		Prime(0xFF);
+
+		this->Primed = false;
+	}
+
+	/************************************************************************/
+	/* Push a raw sample, returns true when a new output is ready			*/
+	/************************************************************************/
+	bool Push(uint8_t sample)
+	{
+		//Start from the first sample instead of the reset value
+		if(!this->Primed)
+		{
+			Prime(sample);
+		}
+
+#if FILTER_MEDIAN3
+		sample = Median(sample);
+#endif
+
+		//Oversample and decimate
+		this->Accumulator += sample;
+
+		if(++this->AccumulatorCount < FILTER_OVERSAMPLE)
+		{
+			return false;
+		}
+
+		uint8_t decimated = this->Accumulator / FILTER_OVERSAMPLE;
+
+		this->Accumulator = 0;
+		this->AccumulatorCount = 0;
+
+		this->Output = Smooth(decimated);
+
+		return true;
+	}
+
+	/************************************************************************/
+	/* Get the latest filtered value										*/
+	/************************************************************************/
+	uint8_t GetOutput(void)
+	{
+		return this->Output;
+	}
+};
+
+#endif /* FILTER_H_ */
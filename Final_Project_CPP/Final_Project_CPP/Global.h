@@ -21,10 +21,44 @@
 #define No_MORE_MARBLES_THRESHOLD 80	//Number of ms to wait when checking for more marbles
 
 //EEPROM Addresses
-#define MIN_ADDR			0x00	//Address for minutes
-#define SEC_ADDR			0x01	//Address for seconds
-#define BLACK_COUNT_ADDR	0x02	//Address for black count
-#define WHITE_COUNT_ADDR	0x03	//Address for white count
+#define COUNT_LOG_START_ADDR	0x000	//First address of the count log (see CountLog.h)
+#define COUNT_LOG_END_ADDR		0x300	//One past the last address of the count log
+#define HISTORY_START_ADDR		0x300	//First address of the run history (see RunHistory.h)
+#define HISTORY_END_ADDR		0x400	//One past the last address of the run history (1KB EEPROM)
+#define EEPROM_QUEUE_LEN		32		//Bytes the EEPROM writer can queue (must be a power of 2)
+#define EEPROM_READY_SCAN		4		//Most unchanged bytes skipped per EEPROM ready interrupt
+#define COUNT_RECORD_VERSION	3		//Count log record layout version
+#define RUN_SUMMARY_VERSION		1		//Run history record layout version
+
+//Checkpoint Definitions
+#define CHECKPOINT_MARBLES	10		//Marbles sorted between checkpoints
+#define CHECKPOINT_SECONDS	30		//Seconds of sorting between checkpoints
+
+//User Interface Definitions
+#ifndef UI_FRAME_MS
+#define UI_FRAME_MS			200		//Time between frames of the sort screen in ms (a multiple of 10),
+									//	may be set by the build
+#endif
+#define UI_RENDER_CELLS		4		//Most LCD cells sent per release of the UI task
+
+//Task Definitions (see the task table in main.cpp)
+#define TASK_SENSE_MS		10		//Period of the sense task in ms
+#define TASK_INPUT_MS		10		//Period of the input task in ms
+#define TASK_UI_MS			10		//Period of the UI task in ms
+#define TASK_PERSIST_MS		10		//Period of the persistence task in ms
+#define TASK_TELEMETRY_MS	1000	//Period of the telemetry task in ms
+#define NO_MARBLES_BLINK_MS	200		//Time the LED spends on or off blinking "No More Marbles"
+#define RESET_DOT_MS		200		//Time between the dots after "Reset"
+#define RESET_HOLD_MS		1000	//Time "Reset..." stays up once the counts are cleared
+
+#ifndef POWER_FAIL_SENSE
+#define POWER_FAIL_SENSE	0		//Checkpoint on the power fail input (0 or 1), may be set by the build
+#endif
+
+#ifndef RESUME_ON_BOOT
+#define RESUME_ON_BOOT		0		//Go straight back to sorting if a run was interrupted (0 or 1),
+									//	may be set by the build
+#endif
 
 //Pin Definitions
 //OUTPUTS
@@ -36,9 +70,14 @@
 #define LCD_SCL				_BV(5)				//SCL on PC5							(Analog Pin 5)
 
 #define SERVO_EN			_BV(5)				//Servo Power Supply Enable on PD5		(Digital Pin 5)
-#define SERVO_PWM			_BV(2)				//Servo PWM on PB2 (OC1B)				(Digital Pin 10)
-#define SWITCH_S0			_BV(4)				//Switch Select 0 on PD4				(Digital Pin 4)
-#define SWITCH_S1			_BV(2)				//Switch Select 1 on PB2				(Digital Pin 10)
+#define SERVO_PWM			_BV(2)				//Servo 0 PWM on PB2 (OC1B)				(Digital Pin 10)
+#define SERVO_PWM_1			_BV(1)				//Servo 1 PWM on PB1 (OC1A)				(Digital Pin 9)
+#define SERVO_PWM_2			_BV(4)				//Servo 2 pulse on PD4 (multiplexer)	(Digital Pin 4)
+#define SERVO_PWM_3			_BV(3)				//Servo 3 pulse on PB3 (multiplexer)	(Digital Pin 11)
+#define SERVO_PWM_4			_BV(4)				//Servo 4 pulse on PB4 (multiplexer)	(Digital Pin 12)
+#define SERVO_PWM_5			_BV(5)				//Servo 5 pulse on PB5 (multiplexer)	(Digital Pin 13)
+#define SERVO_PWM_6			_BV(2)				//Servo 6 pulse on PC2 (multiplexer)	(Analog Pin 2)
+#define SERVO_PWM_7			_BV(3)				//Servo 7 pulse on PC3 (multiplexer)	(Analog Pin 3)
 
 #define SENSOR_EN			_BV(0)				//Sensor Enable on PB0					(Digital Pin 8)
 
@@ -48,6 +87,7 @@
 
 #define SENSOR_0			_BV(0)				//Sensor 0 on PC0						(Analog Pin 0)
 #define SENSOR_1			_BV(1)				//Sensor 1 on PC1						(Analog Pin 1)
+#define POWER_FAIL_IN		_BV(3)				//Power Fail (active low) on PC3		(Analog Pin 3)
 	
 //LCD Definitions
 #define I2C_ADDRESS 0x27		//LCD I2C Address
@@ -69,25 +109,92 @@
 #define LINE_4      3
 
 //Sorter Definitions
+#ifndef SORTER_LANES
+#define SORTER_LANES 1				//Number of sorting lanes (1 or 2), may be set by the build
+#endif
+
 #define WHITE_THRESHOLD 8			//Threshold for a WHITE marble
 #define BLACK_THRESHOLD 20			//Threshold for a BLACK marble
+#define ARRIVAL_DWELL_TIME 20		//Time in ms a marble must stay on the sensor before it is sorted
+#define CLASS_HYSTERESIS 0			//Width of the hold band above each class threshold
+#define MARBLE_CLASS_HOLD 0xFF		//Lookup table entry for a hysteresis band (keep the last type)
 
 //Servo Definitions
 #define PERIOD_CNT 40000		//Period cycle count for 20ms servo PWM period
 #define SERVO_0 0				//Servo 0
 #define SERVO_1 1				//Servo 1 
 
+#define SERVO_DRIVER_PWM 0		//Servos 0 and 1 on the Timer 1 hardware PWM outputs
+#define SERVO_DRIVER_MUX 1		//Up to 8 servos pulsed one after another from the Timer 1 interrupt
+
+#ifndef SERVO_DRIVER
+#define SERVO_DRIVER SERVO_DRIVER_PWM	//Servo driver, may be set by the build
+#endif
+
+#ifndef SERVO_COUNT
+#define SERVO_COUNT 2			//Number of servos (up to 2 with PWM, up to 8 with the multiplexer)
+#endif
+
+#define SERVO_MIN_PULSE_TICKS	500		//Shortest pulse any servo may be given (0.5ms)
+#define SERVO_MAX_PULSE_TICKS	2500	//Longest pulse any servo may be given (2.5ms)
+
+//Servo calibration: Timer 1 ticks (1us) at 0, 90, and 180 degrees
+#define SERVO_0_MIN_TICKS		650
+#define SERVO_0_CENTER_TICKS	1500
+#define SERVO_0_MAX_TICKS		2275
+#define SERVO_1_MIN_TICKS		650
+#define SERVO_1_CENTER_TICKS	1500
+#define SERVO_1_MAX_TICKS		2275
+#define SERVO_2_MIN_TICKS		650
+#define SERVO_2_CENTER_TICKS	1500
+#define SERVO_2_MAX_TICKS		2275
+#define SERVO_3_MIN_TICKS		650
+#define SERVO_3_CENTER_TICKS	1500
+#define SERVO_3_MAX_TICKS		2275
+#define SERVO_4_MIN_TICKS		650
+#define SERVO_4_CENTER_TICKS	1500
+#define SERVO_4_MAX_TICKS		2275
+#define SERVO_5_MIN_TICKS		650
+#define SERVO_5_CENTER_TICKS	1500
+#define SERVO_5_MAX_TICKS		2275
+#define SERVO_6_MIN_TICKS		650
+#define SERVO_6_CENTER_TICKS	1500
+#define SERVO_6_MAX_TICKS		2275
+#define SERVO_7_MIN_TICKS		650
+#define SERVO_7_CENTER_TICKS	1500
+#define SERVO_7_MAX_TICKS		2275
+
+#define SERVO_MOVE_TICKS	20		//Number of 10ms ticks for the servo to swing to a sort position
+#define SERVO_DWELL_TICKS	30		//Number of 10ms ticks to hold the sort position while the marble drops
+#define SERVO_RETURN_TICKS	20		//Number of 10ms ticks for the servo to swing back to nominal
+
 //ADC Definitions
 #define CHANNEL_0 0				//ADC Channel 0 (Sensor 0) on PC0
 #define CHANNEL_1 1				//ADC Channel 1 (Sensor 1) on PC1 
+#define CHANNEL_BANDGAP 14		//ADC Channel 14 (1.1V internal reference)
+#define SAMPLE_BUFFER_LEN 16		//Samples buffered per input (must be a power of 2); at a
+									//	lane's 1.2k samples/s this covers a 13ms main loop pass
+#define ADC_CONVERSION_RATE 9615	//Conversions per second (16MHz / 128 / 13 cycles)
+
+//ADC Scheduler Inputs (see ADCInputs in ADCSampler.h)
+#define ADC_INPUT_LANE_0	0				//Lane 0 sensor, read by the sorter and presence detector
+#define ADC_INPUT_LANE_1	1				//Lane 1 sensor, read by the sorter and presence detector
+#ifdef ADC_SAMPLE_REFERENCE
+#define ADC_INPUT_REFERENCE	SORTER_LANES	//Bandgap reference for supply calibration
+#define ADC_INPUTS			(SORTER_LANES + 1)
+#else
+#define ADC_INPUTS			SORTER_LANES	//Number of inputs scheduled on the ADC
+#endif
 
 //Warning/Error Code Definitions
 #define WAR_NO_MARBLE			-1				//No marble found. Not necessarily an error
+#define WAR_SERVO_BUSY			-2				//Servo is still moving or dwelling from the last marble
 
 #define ERR_NO_ERROR			0				//No error
 #define ERR_WDT_TIMEOUT			-200			//Watchdog timer has timed out; at this point
 												//	the total marble count should be checked
 #define ERR_INVALID_SERVO_ANGLE -201			//The servo angle was not between 0 and 180 degrees
+#define ERR_INVALID_SERVO_PULSE -202			//The servo pulse was outside the allowed range
 
 //Error Code Types
 typedef int T_ErrorCode;		//Typedef for error code type
@@ -112,5 +219,14 @@ void InitEEPROM(void);
 void InitSorter(void);
 void InitLCD(void);
 void PrintIdleScreen(void);
-
-#endif /* GLOBAL_H_ */
\ No newline at end of file
+void PrintSortFrame(void);
+bool PrintRecallPage(int page);
+void PrintTelemetry(void);
+void TaskSort(void);
+void TaskSense(void);
+void TaskInput(void);
+void TaskUI(void);
+void TaskPersist(void);
+void TaskTelemetry(void);
+
+#endif /* GLOBAL_H_ */
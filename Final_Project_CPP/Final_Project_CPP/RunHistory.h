@@ -0,0 +1,313 @@
+/************************************************************************/
+/* File: RunHistory.h													*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: RunHistory.h implements the RunHistory class, a ring of	*/
+/*				the last few sorting run summaries kept in the EEPROM,	*/
+/*				with running totals over the runs in the ring			*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef RUNHISTORY_H_
+#define RUNHISTORY_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <util/crc16.h>
+#include "Global.h"
+#include "EEPROMWriter.h"
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Run summary structure (one history slot)
+typedef struct T_RunSummary
+{
+	uint16_t Sequence;		//Run number (0xFFFF is never written)
+	uint8_t Version;		//Record layout version (RUN_SUMMARY_VERSION)
+	uint32_t StartTime;		//Run clock in ms when the run started
+	uint32_t StopTime;		//Run clock in ms when the run stopped
+	uint32_t BlackCount;	//Black marbles sorted during the run
+	uint32_t WhiteCount;	//White marbles sorted during the run
+	uint16_t Throughput;	//Marbles per minute
+	int16_t Fault;			//Error code the run ended with
+	uint16_t Crc;			//CRC-16 (CCITT) of the fields above (written last)
+}T_RunSummary;
+
+//Run history totals structure
+typedef struct T_RunTotals
+{
+	uint8_t Runs;			//Runs in the history
+	uint32_t BlackCount;	//Black marbles sorted over those runs
+	uint32_t WhiteCount;	//White marbles sorted over those runs
+	uint32_t RunTime;		//Time spent sorting over those runs in ms
+}T_RunTotals;
+
+//Run contribution to the totals structure (one per history slot)
+typedef struct T_RunContribution
+{
+	uint32_t BlackCount;	//Black marbles sorted during the run
+	uint32_t WhiteCount;	//White marbles sorted during the run
+	uint32_t RunTime;		//Time spent sorting during the run in ms
+}T_RunContribution;
+
+#define HISTORY_RUNS ((HISTORY_END_ADDR - HISTORY_START_ADDR) / sizeof(T_RunSummary))
+
+static_assert(sizeof(T_RunSummary) < EEPROM_QUEUE_LEN, "The EEPROM writer queue must hold a whole run summary");
+static_assert(HISTORY_RUNS <= 16, "The valid slot mask holds at most 16 slots");
+
+/************************************************************************/
+/* RunHistory Class														*/
+/************************************************************************/
+//Runs are written round robin over HISTORY_RUNS slots, newest over the
+// oldest. The totals are built once at boot and then kept up to date as
+// each run is added (adding the new run and subtracting the one it
+// replaces), so showing them never reads the history. Each slot's share
+// of the totals is kept in RAM, so adding a run at the end of a sort
+// never reads the EEPROM either.
+class RunHistory
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+	T_RunSummary Newest;			//Copy of the newest run
+	uint8_t NewestSlot;				//Slot holding the newest run
+	bool Pending;					//Whether the newest run still has to be queued
+
+	T_RunTotals Totals;				//Totals over the runs in the history
+	T_RunContribution Slots[HISTORY_RUNS];	//Each slot's share of the totals
+	uint16_t ValidSlots;			//Bit per slot holding a run
+
+	/************************************************************************/
+	/* Private Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* CRC-16 of a run summary, excluding the CRC field						*/
+	/************************************************************************/
+	static uint16_t Crc(const T_RunSummary &summary)
+	{
+		const uint8_t *bytes = (const uint8_t *)&summary;
+		uint16_t crc = 0xFFFF;
+
+		for(uint8_t i = 0; i < offsetof(T_RunSummary, Crc); i++)
+		{
+			crc = _crc_ccitt_update(crc, bytes[i]);
+		}
+
+		return crc;
+	}
+
+	/************************************************************************/
+	/* Read a slot, returns false if it holds no valid run					*/
+	/************************************************************************/
+	static bool ReadSlot(uint8_t slot, T_RunSummary &summary)
+	{
+		eepromWriter.ReadBlock(HISTORY_START_ADDR + (slot * sizeof(T_RunSummary)), &summary, sizeof(summary));
+
+		return (summary.Sequence != 0xFFFF) && (summary.Version == RUN_SUMMARY_VERSION) && (summary.Crc == Crc(summary));
+	}
+
+	/************************************************************************/
+	/* Add or subtract a slot's run from the totals							*/
+	/************************************************************************/
+	void AddToTotals(uint8_t slot, int8_t sign)
+	{
+		const T_RunContribution &run = this->Slots[slot];
+
+		this->Totals.Runs += sign;
+		this->Totals.BlackCount += sign * (int32_t)run.BlackCount;
+		this->Totals.WhiteCount += sign * (int32_t)run.WhiteCount;
+		this->Totals.RunTime += sign * (int32_t)run.RunTime;
+	}
+
+	/************************************************************************/
+	/* Put a run in a slot and add it to the totals							*/
+	/************************************************************************/
+	void SetSlot(uint8_t slot, const T_RunSummary &summary)
+	{
+		this->Slots[slot].BlackCount = summary.BlackCount;
+		this->Slots[slot].WhiteCount = summary.WhiteCount;
+		this->Slots[slot].RunTime = summary.StopTime - summary.StartTime;
+		this->ValidSlots |= (1 << slot);
+
+		AddToTotals(slot, 1);
+	}
+
+	/************************************************************************/
+	/* Take a slot's run, if any, out of the totals							*/
+	/************************************************************************/
+	void ClearSlot(uint8_t slot)
+	{
+		if(this->ValidSlots & (1 << slot))
+		{
+			AddToTotals(slot, -1);
+			this->ValidSlots &= ~(1 << slot);
+		}
+	}
+
+	public :
+
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Default Constructor													*/
+	/************************************************************************/
+	RunHistory()
+	{
+		memset(&this->Newest, 0, sizeof(this->Newest));
+		memset(&this->Totals, 0, sizeof(this->Totals));
+		this->ValidSlots = 0;
+
+		//The first run added is run 0 in slot 0
+		this->Newest.Sequence = 0xFFFF;
+		this->NewestSlot = HISTORY_RUNS - 1;
+		this->Pending = false;
+	}
+
+	/************************************************************************/
+	/* Marbles per minute for a count and a time in ms						*/
+	/************************************************************************/
+	static uint16_t MarblesPerMinute(uint32_t marbles, uint32_t milliseconds)
+	{
+		//Work in tenths of a second so the product stays in 32 bits
+		uint32_t tenths = milliseconds / 100;
+
+		if(tenths == 0)
+		{
+			return 0;
+		}
+
+		return (uint16_t)((marbles * 600) / tenths);
+	}
+
+	/************************************************************************/
+	/* Find the newest run and build the totals								*/
+	/************************************************************************/
+	void Open(void)
+	{
+		T_RunSummary summary;
+		bool found = false;
+
+		memset(&this->Totals, 0, sizeof(this->Totals));
+		this->ValidSlots = 0;
+
+		for(uint8_t slot = 0; slot < HISTORY_RUNS; slot++)
+		{
+			if(!ReadSlot(slot, summary))
+			{
+				continue;
+			}
+
+			SetSlot(slot, summary);
+
+			if(!found || ((int16_t)(summary.Sequence - this->Newest.Sequence) > 0))
+			{
+				this->Newest = summary;
+				this->NewestSlot = slot;
+				found = true;
+			}
+		}
+	}
+
+	/************************************************************************/
+	/* Add a run, replacing the oldest once the history is full				*/
+	/************************************************************************/
+	void Add(uint32_t startTime, uint32_t stopTime, uint32_t blackCount, uint32_t whiteCount, T_ErrorCode fault)
+	{
+		T_RunSummary summary;
+
+		summary.Sequence = this->Newest.Sequence + 1;
+
+		//0xFFFF reads the same as an erased slot
+		if(summary.Sequence == 0xFFFF)
+		{
+			summary.Sequence = 0;
+		}
+
+		summary.Version = RUN_SUMMARY_VERSION;
+		summary.StartTime = startTime;
+		summary.StopTime = stopTime;
+		summary.BlackCount = blackCount;
+		summary.WhiteCount = whiteCount;
+		summary.Throughput = MarblesPerMinute(blackCount + whiteCount, stopTime - startTime);
+		summary.Fault = fault;
+		summary.Crc = Crc(summary);
+
+		//A run still waiting to be queued is replaced and never reaches
+		// the EEPROM, so it is the one overwritten
+		if(!this->Pending && (++this->NewestSlot >= HISTORY_RUNS))
+		{
+			this->NewestSlot = 0;
+		}
+
+		//Take the run being overwritten out of the totals
+		ClearSlot(this->NewestSlot);
+		SetSlot(this->NewestSlot, summary);
+
+		this->Newest = summary;
+		this->Pending = true;
+
+		Flush();
+	}
+
+	/************************************************************************/
+	/* Queue the newest run if it is waiting and the EEPROM writer has room	*/
+	/************************************************************************/
+	void Flush(void)
+	{
+		if(!this->Pending)
+		{
+			return;
+		}
+
+		//The CRC is the last byte queued, so it is the last one programmed
+		if(eepromWriter.WriteBlock(HISTORY_START_ADDR + (this->NewestSlot * sizeof(T_RunSummary)), &this->Newest, sizeof(this->Newest)))
+		{
+			this->Pending = false;
+		}
+	}
+
+	/************************************************************************/
+	/* Check if a run can be read without waiting on the EEPROM writer		*/
+	/************************************************************************/
+	bool IsReadable(uint8_t index)
+	{
+		return (index == 0) || eepromWriter.IsIdle();
+	}
+
+	/************************************************************************/
+	/* Get a run, 0 being the newest, returns false if there is no such run	*/
+	/* or it is not readable yet (see IsReadable)							*/
+	/************************************************************************/
+	bool GetRun(uint8_t index, T_RunSummary &summary)
+	{
+		if((index >= this->Totals.Runs) || !IsReadable(index))
+		{
+			return false;
+		}
+
+		//The newest run may not be programmed yet
+		if(index == 0)
+		{
+			summary = this->Newest;
+			return true;
+		}
+
+		uint8_t slot = (this->NewestSlot + HISTORY_RUNS - index) % HISTORY_RUNS;
+
+		return ReadSlot(slot, summary);
+	}
+
+	/************************************************************************/
+	/* Get the totals over the runs in the history							*/
+	/************************************************************************/
+	const T_RunTotals &GetTotals(void)
+	{
+		return this->Totals;
+	}
+};
+
+#endif /* RUNHISTORY_H_ */
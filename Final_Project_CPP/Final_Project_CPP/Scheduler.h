@@ -0,0 +1,191 @@
+/************************************************************************/
+/* File: Scheduler.h													*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: Scheduler.h implements the Scheduler class, which runs	*/
+/*				the main loop tasks from a table on a millisecond tick	*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <avr/io.h>
+#include <avr/wdt.h>
+#include <util/atomic.h>
+#include "Global.h"
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Task function type
+typedef void (*T_TaskFunction)(void);
+
+//Task table entry structure
+typedef struct T_Task
+{
+	T_TaskFunction Run;		//Task function, runs to completion and returns
+	uint16_t Period;		//Time between releases in ms, 0 to run on every pass
+	uint16_t Deadline;		//Most ms a release may start late before it is a miss
+	uint16_t NextRelease;	//Time of the next release in ms
+	uint8_t Misses;			//Releases that started after their deadline
+}T_Task;
+
+/************************************************************************/
+/* Scheduler Class														*/
+/************************************************************************/
+//Each pass runs every released task once, in table order, so the table
+// order is the priority: a released task runs ahead of every task below
+// it. A task with a period of 0 runs on every pass. Tasks never wait on
+// anything themselves; a task that needs time to pass keeps its own state
+// and checks Now() on its next release.
+//
+//The watchdog is reset once a pass, so a task that hangs stops the
+// petting for every state at once.
+class Scheduler
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+	T_Task *Tasks;					//Task table, highest priority first
+	uint8_t TaskCount;				//Number of tasks in the table
+
+	volatile uint16_t Milliseconds;	//Time in ms, advanced by Tick
+	uint8_t LongestPass;			//Longest pass in ms
+
+	public :
+
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Constructor															*/
+	/************************************************************************/
+	Scheduler(T_Task *tasks, uint8_t taskCount)
+	{
+		this->Tasks = tasks;
+		this->TaskCount = taskCount;
+		this->Milliseconds = 0;
+		this->LongestPass = 0;
+	}
+
+	/************************************************************************/
+	/* Advance the time (called every 1ms from Timer 2)						*/
+	/************************************************************************/
+	void Tick(void)
+	{
+		this->Milliseconds++;
+	}
+
+	/************************************************************************/
+	/* Get the time in ms (wraps every 65.5s; compare differences only)	*/
+	/************************************************************************/
+	uint16_t Now(void)
+	{
+		uint16_t now;
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			now = this->Milliseconds;
+		}
+
+		return now;
+	}
+
+	/************************************************************************/
+	/* Release every task now (call once setup is done)						*/
+	/************************************************************************/
+	void Start(void)
+	{
+		uint16_t now = Now();
+
+		for(uint8_t i = 0; i < this->TaskCount; i++)
+		{
+			this->Tasks[i].NextRelease = now;
+			this->Tasks[i].Misses = 0;
+		}
+
+		this->LongestPass = 0;
+	}
+
+	/************************************************************************/
+	/* Run one pass over the task table										*/
+	/************************************************************************/
+	void RunOnce(void)
+	{
+		uint16_t start = Now();
+		uint16_t pass;
+
+		wdt_reset();
+
+		for(uint8_t i = 0; i < this->TaskCount; i++)
+		{
+			T_Task &task = this->Tasks[i];
+
+			if(task.Period != 0)
+			{
+				uint16_t now = Now();
+				int16_t late = (int16_t)(now - task.NextRelease);
+
+				//Not released yet
+				if(late < 0)
+				{
+					continue;
+				}
+
+				if((late > (int16_t)task.Deadline) && (task.Misses < 0xFF))
+				{
+					task.Misses++;
+				}
+
+				//Skip releases that have already gone by rather than
+				// running the task back to back to catch up
+				task.NextRelease += task.Period;
+
+				if((int16_t)(now - task.NextRelease) >= 0)
+				{
+					task.NextRelease = now + task.Period;
+				}
+			}
+
+			task.Run();
+		}
+
+		pass = Now() - start;
+
+		if(pass > this->LongestPass)
+		{
+			this->LongestPass = (pass > 0xFF) ? 0xFF : pass;
+		}
+	}
+
+	/************************************************************************/
+	/* Get the number of releases that missed their deadline				*/
+	/************************************************************************/
+	uint16_t GetMisses(void)
+	{
+		uint16_t misses = 0;
+
+		for(uint8_t i = 0; i < this->TaskCount; i++)
+		{
+			misses += this->Tasks[i].Misses;
+		}
+
+		return misses;
+	}
+
+	/************************************************************************/
+	/* Get the longest pass over the task table in ms						*/
+	/************************************************************************/
+	uint8_t GetLongestPass(void)
+	{
+		return this->LongestPass;
+	}
+};
+
+//The scheduler instance (defined in main.cpp)
+extern Scheduler scheduler;
+
+#endif /* SCHEDULER_H_ */
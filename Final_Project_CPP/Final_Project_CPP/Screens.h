@@ -0,0 +1,112 @@
+/************************************************************************/
+/* File: Screens.h														*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: Screens.h holds the user interface text and the fixed	*/
+/*				screen layouts in flash, drawn with the Display _P		*/
+/*				methods													*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef SCREENS_H_
+#define SCREENS_H_
+
+#include <avr/pgmspace.h>
+#include "Global.h"
+#include "Display.h"
+
+/************************************************************************/
+/* Text																	*/
+/************************************************************************/
+//String literals are copied to SRAM at startup; these stay in flash
+
+//Splash screen
+static const char TextTitle[] PROGMEM = "Gibson-Millwood";
+static const char TextName[] PROGMEM = "Marble Sorter";
+static const char TextVersion[] PROGMEM = "V1.00";
+
+//Idle screen
+static const char TextPressSort[] PROGMEM = "PRESS S -> Sort";
+static const char TextPressReset[] PROGMEM = "PRESS R -> Reset";
+static const char TextHoldRecall[] PROGMEM = "HOLD  S -> Recall";
+static const char TextNoMarbles[] PROGMEM = "No More Marbles";
+static const char TextReset[] PROGMEM = "Reset";
+
+//Sort screen
+static const char TextSorting[] PROGMEM = "Sorting";
+static const char TextDots[4][4] PROGMEM = { "   ", ".  ", ".. ", "..." };
+static const char TextClockIndent[] PROGMEM = "     ";
+static const char TextClockEnd[] PROGMEM = "00    ";
+
+//Error and test screens
+static const char TextError[] PROGMEM = "        ERROR       ";
+static const char TextContinue[] PROGMEM = "PRESS S to Continue";
+static const char TextTestState[] PROGMEM = "TEST STATE";
+
+//Telemetry, drawn on the test screen
+static const char TextLost[] PROGMEM = "Lost: ";
+static const char TextMisses[] PROGMEM = "Miss: ";
+static const char TextLongest[] PROGMEM = " Pass: ";
+static const char TextLateness[] PROGMEM = "Late:";
+static const char TextLatenessOver[] PROGMEM = "Late!";
+
+//Counts, shared by the sort and recall screens
+static const char TextWhite[] PROGMEM = "W: ";
+static const char TextBlack[] PROGMEM = "    B: ";
+static const char TextTime[] PROGMEM = "Time: ";
+static const char TextPerMinute[] PROGMEM = "/min";
+
+//Recall screens
+static const char TextRecall[] PROGMEM = "Recall Information";
+static const char TextWhiteCount[] PROGMEM = "White Count: ";
+static const char TextBlackCount[] PROGMEM = "Black Count: ";
+static const char TextRunNotReadable[] PROGMEM = "Run Not Readable";
+static const char TextRun[] PROGMEM = "Run ";
+static const char TextFault[] PROGMEM = " Fault ";
+static const char TextRate[] PROGMEM = "Rate: ";
+static const char TextLast[] PROGMEM = "Last ";
+static const char TextRuns[] PROGMEM = " Runs";
+static const char TextMean[] PROGMEM = "Mean: ";
+
+/************************************************************************/
+/* Screen Layouts														*/
+/************************************************************************/
+static const T_ScreenText IdleScreen[] PROGMEM =
+{
+	{ 0, LINE_1, TextPressSort },
+	{ 0, LINE_2, TextPressReset },
+	{ 0, LINE_3, TextHoldRecall },
+	SCREEN_END
+};
+
+static const T_ScreenText SortScreen[] PROGMEM =
+{
+	{ 0, LINE_1, TextSorting },
+	SCREEN_END
+};
+
+static const T_ScreenText ErrorScreen[] PROGMEM =
+{
+	{ 0, LINE_2, TextError },
+	{ 0, LINE_3, TextContinue },
+	SCREEN_END
+};
+
+static const T_ScreenText TestScreen[] PROGMEM =
+{
+	{ 0, LINE_1, TextTestState },
+	SCREEN_END
+};
+
+static const T_ScreenText RecallScreen[] PROGMEM =
+{
+	{ 0, LINE_1, TextRecall },
+	{ 0, LINE_2, TextTime },
+	{ 0, LINE_3, TextWhiteCount },
+	{ 0, LINE_4, TextBlackCount },
+	SCREEN_END
+};
+
+#endif /* SCREENS_H_ */
@@ -12,9 +12,75 @@
 #ifndef SERVO_H_
 #define SERVO_H_
 
+#include <util/atomic.h>
+#include <avr/pgmspace.h>
 #include "Global.h"
 #include "Marble.h"
 
+#if SERVO_DRIVER == SERVO_DRIVER_MUX
+#include "ServoMux.h"
+#elif SERVO_COUNT > 2
+#error "Timer 1 hardware PWM drives at most 2 servos, use SERVO_DRIVER_MUX for more"
+#endif
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Servo actuation state enumeration
+typedef enum T_ActuationState
+{
+	ActuationIdle,			//Servo is at nominal and ready for a marble
+	ActuationMove,			//Servo is swinging to the sort position
+	ActuationDwell,			//Servo is holding the sort position
+	ActuationReturn			//Servo is swinging back to nominal
+}T_ActuationState;
+
+/************************************************************************/
+/* Servo Pulse Table													*/
+/************************************************************************/
+//Timer 1 ticks for an angle, interpolated between a servo's calibrated
+// 0, 90, and 180 degree pulse widths
+constexpr uint16_t ServoTicks(unsigned degrees, unsigned minTicks, unsigned centerTicks, unsigned maxTicks)
+{
+	return (degrees <= 90) ?
+		minTicks + (((centerTicks - minTicks) * degrees) + 45) / 90 :
+		centerTicks + (((maxTicks - centerTicks) * (degrees - 90)) + 45) / 90;
+}
+
+#define SERVO_TABLE_1(n, i)		ServoTicks(i, SERVO_##n##_MIN_TICKS, SERVO_##n##_CENTER_TICKS, SERVO_##n##_MAX_TICKS)
+#define SERVO_TABLE_4(n, i)		SERVO_TABLE_1(n, i), SERVO_TABLE_1(n, (i) + 1), SERVO_TABLE_1(n, (i) + 2), SERVO_TABLE_1(n, (i) + 3)
+#define SERVO_TABLE_16(n, i)	SERVO_TABLE_4(n, i), SERVO_TABLE_4(n, (i) + 4), SERVO_TABLE_4(n, (i) + 8), SERVO_TABLE_4(n, (i) + 12)
+#define SERVO_TABLE_64(n, i)	SERVO_TABLE_16(n, i), SERVO_TABLE_16(n, (i) + 16), SERVO_TABLE_16(n, (i) + 32), SERVO_TABLE_16(n, (i) + 48)
+#define SERVO_TABLE(n)			{SERVO_TABLE_64(n, 0), SERVO_TABLE_64(n, 64), SERVO_TABLE_16(n, 128), SERVO_TABLE_16(n, 144), \
+								 SERVO_TABLE_16(n, 160), SERVO_TABLE_4(n, 176), SERVO_TABLE_1(n, 180)}
+
+//Angle (0 to 180 degrees) to Timer 1 ticks for each servo
+static const uint16_t ServoPulseTable[SERVO_COUNT][181] PROGMEM =
+{
+	SERVO_TABLE(0),
+#if SERVO_COUNT > 1
+	SERVO_TABLE(1),
+#endif
+#if SERVO_COUNT > 2
+	SERVO_TABLE(2),
+#endif
+#if SERVO_COUNT > 3
+	SERVO_TABLE(3),
+#endif
+#if SERVO_COUNT > 4
+	SERVO_TABLE(4),
+#endif
+#if SERVO_COUNT > 5
+	SERVO_TABLE(5),
+#endif
+#if SERVO_COUNT > 6
+	SERVO_TABLE(6),
+#endif
+#if SERVO_COUNT > 7
+	SERVO_TABLE(7),
+#endif
+};
+
 /************************************************************************/
 /* Servo Class															*/
 /************************************************************************/
@@ -25,60 +91,13 @@ class Servo
 	/************************************************************************/
 	int Index;
 	
-	/************************************************************************/
-	/* Private Methods														*/
-	/************************************************************************/
-	/************************************************************************/
-	/* Set servo to an angle in degrees										*/
-	/************************************************************************/
-	T_ErrorCode SetServoAngle(double degrees)
-	{
-		//BYPASSING SWITCH
-		/*
-		//Select the correct line to switch servo
-		if(this->Index == 0)
-		{
-			PORTD |= SWITCH_S0;
-			PORTB &= ~SWITCH_S1;	
-		}
-		
-		if(this->Index == 1)
-		{
-			PORTD &= ~SWITCH_S0;
-			PORTB |= SWITCH_S1;
-		}
-		*/
-		
-		//Declare an offset variable to attempt to reach
-		// max swing
-		int offset = 0;
+#if SERVO_DRIVER == SERVO_DRIVER_PWM
+	volatile uint16_t *CompareRegister;			//Timer 1 compare register driving this servo
+#endif
 	
-		//Check for angles outside of range
-		if((degrees < 0) || degrees > 180)
-		{
-			//Only valid for 0 to 180 degrees
-			return ERR_INVALID_SERVO_ANGLE;
-		}
-	
-		//Check to see if necessary
-		//Apply negative offset for 0 degrees
-		if(degrees == 0)
-		{
-			offset = -700;
-		}
-    
-		//Apply positive offset for 180 degrees
-		if(degrees == 180)
-		{
-			offset = 550;
-		}
+	volatile T_ActuationState ActuationState;	//Current step of the actuation cycle
+	volatile uint8_t ActuationTicks;			//10ms ticks remaining in the current step
 	
-		//Convert from  0 to 180 degrees to 1.0 to 2.0ms Ton
-		OCR1B = (int)(((((degrees / 180) + 1.0) / 20.0) * PERIOD_CNT) + offset)>> 1;
-		
-		return ERR_NO_ERROR;
-	}
-		
 	public :
 		
 	/************************************************************************/
@@ -89,7 +108,9 @@ class Servo
 	/************************************************************************/
 	Servo()
 	{
-		this->Index = 0;	
+		this->SetIndex(0);
+		this->ActuationState = ActuationIdle;
+		this->ActuationTicks = 0;
 	}
 	
 	/************************************************************************/
@@ -97,7 +118,9 @@ class Servo
 	/************************************************************************/
 	Servo(int index)
 	{
-		this->Index = index;
+		this->SetIndex(index);
+		this->ActuationState = ActuationIdle;
+		this->ActuationTicks = 0;
 	}
 	
 	/************************************************************************/
@@ -108,6 +131,42 @@ class Servo
 			
 	}
 	
+	/************************************************************************/
+	/* Set the servo pulse width in Timer 1 ticks (1 tick = 1us)			*/
+	/************************************************************************/
+	T_ErrorCode SetPulseTicks(uint16_t ticks)
+	{
+		//Keep the pulse inside what the servos can take
+		if((ticks < SERVO_MIN_PULSE_TICKS) || (ticks > SERVO_MAX_PULSE_TICKS))
+		{
+			return ERR_INVALID_SERVO_PULSE;
+		}
+		
+#if SERVO_DRIVER == SERVO_DRIVER_MUX
+		//The multiplexer picks up the new width at the servo's next pulse
+		servoMux.SetPulse(this->Index, ticks);
+#else
+		//Each servo has its own hardware PWM output
+		*(this->CompareRegister) = ticks;
+#endif
+		
+		return ERR_NO_ERROR;
+	}
+	
+	/************************************************************************/
+	/* Set servo to an angle in degrees										*/
+	/************************************************************************/
+	T_ErrorCode SetAngle(uint8_t degrees)
+	{
+		//Only valid for 0 to 180 degrees
+		if(degrees > 180)
+		{
+			return ERR_INVALID_SERVO_ANGLE;
+		}
+		
+		return SetPulseTicks(pgm_read_word(&ServoPulseTable[this->Index][degrees]));
+	}
+	
 	/************************************************************************/
 	/* Get index															*/
 	/************************************************************************/
@@ -122,6 +181,18 @@ class Servo
 	void SetIndex(int index)
 	{
 		this->Index = index;
+		
+#if SERVO_DRIVER == SERVO_DRIVER_PWM
+		//Servo 0 is driven by OC1B (PB2) and servo 1 by OC1A (PB1)
+		if(index == SERVO_1)
+		{
+			this->CompareRegister = &OCR1A;
+		}
+		else
+		{
+			this->CompareRegister = &OCR1B;
+		}
+#endif
 	}
 	
 	/************************************************************************/
@@ -149,11 +220,11 @@ class Servo
 		{
 			if(this->Index == 0)
 			{
-				this->SetServoAngle(180);
+				this->SetAngle(180);
 			}
 			else
 			{
-				this->SetServoAngle(0);
+				this->SetAngle(0);
 			}
 		}
 		
@@ -161,24 +232,96 @@ class Servo
 		{
 			if(this->Index == 0)
 			{
-				this->SetServoAngle(0);
+				this->SetAngle(0);
 			}
 			else
 			{
-				this->SetServoAngle(180);
+				this->SetAngle(180);
 			}
 		}
 		
 		else
 		{
 			//Set servo to 90 degrees
-			this->SetServoAngle(90);
+			this->SetAngle(90);
 		}
 		
 		return ERR_NO_ERROR;
 	}
+	
+	/************************************************************************/
+	/* Start an actuation cycle for the marble type sensed					*/
+	/************************************************************************/
+	T_ErrorCode Actuate(T_MarbleType marbleType)
+	{
+		T_ErrorCode errorCode = ERR_NO_ERROR;
+		
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			//A new marble may only be commanded once the gate is clear,
+			// which includes overlapping the return stroke
+			if((this->ActuationState == ActuationMove) || (this->ActuationState == ActuationDwell))
+			{
+				errorCode = WAR_SERVO_BUSY;
+			}
+			else
+			{
+				this->SetServo(marbleType);
+				this->ActuationState = ActuationMove;
+				this->ActuationTicks = SERVO_MOVE_TICKS;
+			}
+		}
+		
+		return errorCode;
+	}
+	
+	/************************************************************************/
+	/* Check if the servo can accept a new marble							*/
+	/************************************************************************/
+	bool IsReady(void)
+	{
+		T_ActuationState state = this->ActuationState;
+		
+		return (state == ActuationIdle) || (state == ActuationReturn);
+	}
+	
+	/************************************************************************/
+	/* Advance the actuation cycle (called every 10ms from Timer 0)			*/
+	/************************************************************************/
+	void Tick(void)
+	{
+		if(this->ActuationState == ActuationIdle)
+		{
+			return;
+		}
+		
+		if(this->ActuationTicks > 0)
+		{
+			this->ActuationTicks--;
+			return;
+		}
+		
+		switch(this->ActuationState)
+		{
+			case ActuationMove:
+				this->ActuationState = ActuationDwell;
+				this->ActuationTicks = SERVO_DWELL_TICKS;
+				break;
+				
+			case ActuationDwell:
+				//Return to nominal
+				this->SetServo(NoMarble);
+				this->ActuationState = ActuationReturn;
+				this->ActuationTicks = SERVO_RETURN_TICKS;
+				break;
+				
+			default:
+				this->ActuationState = ActuationIdle;
+				break;
+		}
+	}
 };
 
 
 
-#endif /* SERVO_H_ */
\ No newline at end of file
+#endif /* SERVO_H_ */
@@ -0,0 +1,235 @@
+/************************************************************************/
+/* File: ServoMux.h														*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: ServoMux.h implements the ServoMux class, which drives	*/
+/*				up to 8 servos from Timer 1 by pulsing them one after	*/
+/*				another inside each 20ms frame							*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#ifndef SERVOMUX_H_
+#define SERVOMUX_H_
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "Global.h"
+
+#if SERVO_COUNT > 8
+#error "The servo multiplexer drives at most 8 servos"
+#endif
+
+#if POWER_FAIL_SENSE && (SERVO_COUNT > 7)
+#error "Servo 7 and the power fail input are both on PC3"
+#endif
+
+//Servo Multiplexer Definitions
+#define SERVO_MUX_FRAME_TICKS	40000	//20ms frame in Timer 1 ticks (0.5us at 1:8 prescale)
+#define SERVO_MUX_MIN_GAP_TICKS	50		//Shortest gap between the last pulse and the next frame
+#define SERVO_MUX_LATENESS_US	50		//Worst edge lateness worked out below in us
+
+/************************************************************************/
+/* Enumerations and Structures											*/
+/************************************************************************/
+//Servo pin structure
+typedef struct T_ServoPin
+{
+	volatile uint8_t *Port;		//Output port register
+	volatile uint8_t *Ddr;		//Data direction register
+	uint8_t Mask;				//Pin mask
+}T_ServoPin;
+
+/************************************************************************/
+/* Servo Pin Table														*/
+/************************************************************************/
+//Pulse output for each servo, indexed by servo number
+static const T_ServoPin ServoPins[8] =
+{
+	{&PORTB, &DDRB, SERVO_PWM},
+	{&PORTB, &DDRB, SERVO_PWM_1},
+	{&PORTD, &DDRD, SERVO_PWM_2},
+	{&PORTB, &DDRB, SERVO_PWM_3},
+	{&PORTB, &DDRB, SERVO_PWM_4},
+	{&PORTB, &DDRB, SERVO_PWM_5},
+	{&PORTC, &DDRC, SERVO_PWM_6},
+	{&PORTC, &DDRC, SERVO_PWM_7}
+};
+
+/************************************************************************/
+/* ServoMux Class														*/
+/************************************************************************/
+//Timer 1 free runs at 0.5us per tick and the OCR1A interrupt produces
+// every edge. Each frame pulses servo 0, then servo 1, and so on, then
+// idles until 20ms after the frame started. With the 2.5ms maximum pulse,
+// 8 servos fit in one frame.
+//
+//Jitter: every edge is scheduled at an absolute timer value, so lateness
+// never accumulates from edge to edge, and a pulse width is off by at most
+// the difference between the lateness of its two edges.
+//
+//Interrupts do not nest, so a due edge waits for whatever is running and
+// then for any pending interrupt with a lower vector number. The times
+// below are cycles counted from the source at 16MHz, including the
+// register saves, rounded up.
+//
+//Blocks the edge until it ends (only one of these at a time):
+//	TIMER0_COMPA	20us	every 10ms: servo ticks, run clock, frame,
+//							checkpoint and LED flash counters
+//	TWI (Wire)		10us	per LCD byte sent for the UI task
+//	EE_READY		10us	per byte programmed, skipping at most
+//							EEPROM_READY_SCAN unchanged bytes
+//	ADC				 8us	every 104us: one conversion into the ring
+//	ATOMIC_BLOCK	 6us	main context: Servo::Actuate; GetRunTime,
+//							SetLEDColor, EEPROMWriter::ReadBlock,
+//							Scheduler::Now and SetPulse take 2us or less
+//
+//Served first if pending when that ends (each at most once per edge):
+//	PCINT1			 4us	power fail, only with POWER_FAIL_SENSE
+//	WDT				 4us	every 4s
+//	TIMER2_COMPA	15us	every 1ms: sample and task tick, marble check,
+//							button debounce
+//
+//Plus the edge's own entry up to the TCNT1 read in OnCompare, 3us. The
+// Arduino Timer 0 overflow is off (InitTimers replaces TIMSK0) and the
+// USART is unused.
+//
+//The worst case is 20 + 4 + 4 + 15 + 3 = 46us, which SERVO_MUX_LATENESS_US
+// rounds up to 50us. Most edges see only the entry time or one ADC
+// conversion. The worst lateness actually seen is recorded by
+// GetMaxLateness and shown on the test screen, which flags it if it ever
+// goes past SERVO_MUX_LATENESS_US.
+class ServoMux
+{
+	/************************************************************************/
+	/* Private Members														*/
+	/************************************************************************/
+	volatile uint16_t Pulse[SERVO_COUNT];	//Pulse width for each servo in timer ticks
+
+	uint8_t Channel;						//Servo being pulsed (SERVO_COUNT while idle)
+	uint16_t FrameStart;					//Timer value the current frame started at
+
+	volatile uint16_t MaxLateness;			//Worst edge lateness seen in timer ticks
+
+	public :
+
+	/************************************************************************/
+	/* Public Methods														*/
+	/************************************************************************/
+	/************************************************************************/
+	/* Default Constructor													*/
+	/************************************************************************/
+	ServoMux()
+	{
+		for(int i = 0; i < SERVO_COUNT; i++)
+		{
+			//Start every servo at 1.5ms
+			this->Pulse[i] = 1500 << 1;
+		}
+
+		this->Channel = SERVO_COUNT;
+		this->FrameStart = 0;
+		this->MaxLateness = 0;
+	}
+
+	/************************************************************************/
+	/* Start Timer 1 and the pulse train									*/
+	/************************************************************************/
+	void Start(void)
+	{
+		for(int i = 0; i < SERVO_COUNT; i++)
+		{
+			*ServoPins[i].Port &= ~ServoPins[i].Mask;
+			*ServoPins[i].Ddr |= ServoPins[i].Mask;
+		}
+
+		//Normal mode, 1:8 Prescaler
+		TCCR1A = 0;
+		TCCR1B = _BV(CS11);
+
+		this->Channel = SERVO_COUNT;
+		this->FrameStart = TCNT1;
+
+		OCR1A = this->FrameStart + SERVO_MUX_MIN_GAP_TICKS;
+		TIFR1 = _BV(OCF1A);
+		TIMSK1 |= _BV(OCIE1A);
+	}
+
+	/************************************************************************/
+	/* Set a servo's pulse width in microseconds							*/
+	/************************************************************************/
+	void SetPulse(int servo, uint16_t microseconds)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			this->Pulse[servo] = microseconds << 1;
+		}
+	}
+
+	/************************************************************************/
+	/* Generate the next edge (called from TIMER1_COMPA_vect)				*/
+	/************************************************************************/
+	void OnCompare(void)
+	{
+		uint16_t scheduled = OCR1A;
+		uint16_t lateness = TCNT1 - scheduled;
+
+		if(lateness > this->MaxLateness)
+		{
+			this->MaxLateness = lateness;
+		}
+
+		//End the pulse in progress, or start a new frame after the gap
+		if(this->Channel < SERVO_COUNT)
+		{
+			*ServoPins[this->Channel].Port &= ~ServoPins[this->Channel].Mask;
+			this->Channel++;
+		}
+		else
+		{
+			this->Channel = 0;
+			this->FrameStart = scheduled;
+		}
+
+		//Start the next servo's pulse
+		if(this->Channel < SERVO_COUNT)
+		{
+			*ServoPins[this->Channel].Port |= ServoPins[this->Channel].Mask;
+			OCR1A = scheduled + this->Pulse[this->Channel];
+		}
+
+		//Idle until the end of the frame
+		else
+		{
+			uint16_t frameEnd = this->FrameStart + SERVO_MUX_FRAME_TICKS;
+
+			if((int16_t)(frameEnd - scheduled) < SERVO_MUX_MIN_GAP_TICKS)
+			{
+				frameEnd = scheduled + SERVO_MUX_MIN_GAP_TICKS;
+			}
+
+			OCR1A = frameEnd;
+		}
+	}
+
+	/************************************************************************/
+	/* Get the worst edge lateness seen in microseconds						*/
+	/************************************************************************/
+	uint16_t GetMaxLateness(void)
+	{
+		uint16_t lateness;
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			lateness = this->MaxLateness;
+		}
+
+		return lateness >> 1;
+	}
+};
+
+//The multiplexer instance (defined in main.cpp)
+extern ServoMux servoMux;
+
+#endif /* SERVOMUX_H_ */
@@ -18,6 +18,11 @@
 #include "Global.h"
 #include "Marble.h"
 #include "Servo.h"
+#include "ADCSampler.h"
+#include "Filter.h"
+#include "Classifier.h"
+#include "CountLog.h"
+#include "RunHistory.h"
 
 /************************************************************************/
 /* Enumerations and Structures											*/
@@ -29,7 +34,8 @@ typedef enum T_State
 	SortState,
 	RecallState,
 	ResetState,
-	TestState
+	TestState,
+	ErrorState
 }T_State;
 
 //Button Action enumeration
@@ -43,9 +49,9 @@ typedef enum T_ButtonAction
 //Marble Count structure
 typedef struct T_MarbleCount
 {
-	int BlackCount;
-	int WhiteCount;
-	int TotalCount;
+	uint32_t BlackCount;
+	uint32_t WhiteCount;
+	uint32_t TotalCount;
 	
 	//Constructor
 	T_MarbleCount()
@@ -63,6 +69,35 @@ typedef struct T_MarbleCount
 	
 }T_MarbleCount;
 
+//Sorter state the user interface draws from
+typedef struct T_SorterSnapshot
+{
+	uint32_t BlackCount;		//Black marbles sorted
+	uint32_t WhiteCount;		//White marbles sorted
+	uint32_t RunTime;			//Time spent sorting in ms
+}T_SorterSnapshot;
+
+//Arrival Detector structure
+typedef struct T_ArrivalDetector
+{
+	bool Present;				//Whether the lane sensor currently sees a marble
+	bool Sorted;				//Whether the marble present has already been sorted
+	uint16_t ArrivalTime;		//Timestamp of the absent to present edge in ms
+	T_MarbleType Held;			//Settled marble held back by a busy gate
+	T_MarbleType Waiting;		//Held marble that left the sensor before the gate freed
+	
+	//Constructor
+	T_ArrivalDetector()
+	{
+		this->Present = false;
+		this->Sorted = false;
+		this->ArrivalTime = 0;
+		this->Held = NoMarble;
+		this->Waiting = NoMarble;
+	}
+	
+}T_ArrivalDetector;
+
 /************************************************************************/
 /* Sorter Class															*/
 /************************************************************************/
@@ -72,78 +107,147 @@ class Sorter
 	/* Private Methods														*/
 	/************************************************************************/
 	/************************************************************************/
-	/* Set the ADC to a channel												*/
+	/* Classify a sample													*/
 	/************************************************************************/
-	T_ErrorCode SelectADCChannel(int channel)
+	T_ErrorCode ClassifySample(uint8_t value, Marble &marble)
 	{
-		//Set corresponding channel bits
-		ADMUX |= _BV(REFS0) | _BV(ADLAR) | channel;
-		
-		return ERR_NO_ERROR;
-	}
-	
-	/************************************************************************/
-	/* Check the sensor on the given channel								*/
-	/************************************************************************/
-	T_ErrorCode CheckSensorOnChannel(int channel, Marble &marble)
-	{
-		//Select the channel
-		SelectADCChannel(channel);
-		
-		//Check for White Marble
-		if(ADCH <= WHITE_THRESHOLD)
-		{
-			//Set MarbleType
-			marble.SetMarbleType(White);
-			
-			return ERR_NO_ERROR;
-		}
+		uint8_t marbleClass = LookUpMarbleClass(value);
 		
-		//Check for Black Marble
-		else if((ADCH >= WHITE_THRESHOLD) && (ADCH <= BLACK_THRESHOLD))
+		//Samples in a hysteresis band keep the last marble type
+		if(marbleClass != MARBLE_CLASS_HOLD)
 		{
-			//Set MarbleType
-			marble.SetMarbleType(Black);
-			
-			return ERR_NO_ERROR;
+			marble.SetMarbleType((T_MarbleType)marbleClass);
 		}
 		
-		//No Marble
-		else
+		if(marble.GetMarbleType() == NoMarble)
 		{
-			//Set MarbleType
-			marble.SetMarbleType(NoMarble);
-			
 			return WAR_NO_MARBLE;
 		}
+		
+		return ERR_NO_ERROR;
 	}
 	
 	/************************************************************************/
 	/* Update the MarbleCount structure										*/
 	/************************************************************************/
-	void UpdateCount(T_MarbleType marbleType)
+	void UpdateCount(T_MarbleType marbleType, T_MarbleCount &laneCount)
 	{	
 		if(marbleType == Black)
 		{
+			laneCount.BlackCount++;
+			laneCount.TotalCount++;
 			this->MarbleCount.BlackCount++;
 			this->MarbleCount.TotalCount++;
-			
-			//Write to EEPROM
-			eeprom_update_byte((uint8_t *)BLACK_COUNT_ADDR, (uint8_t)(this->MarbleCount.BlackCount));
 		}
 		
 		if(marbleType == White)
 		{
+			laneCount.WhiteCount++;
+			laneCount.TotalCount++;
 			this->MarbleCount.WhiteCount++;
 			this->MarbleCount.TotalCount++;
+		}
+		
+		//Only the RAM copy changes here; FlushCheckpoint writes it out
+		if((marbleType == Black) || (marbleType == White))
+		{
+			if(++this->CheckpointMarbles >= CHECKPOINT_MARBLES)
+			{
+				RequestCheckpoint();
+			}
+		}
+	}
+	
+	/************************************************************************/
+	/* Perform one sorting cycle on a single lane							*/
+	/************************************************************************/
+	//Every queued sample is filtered and classified. A marble is sorted
+	// exactly once: when it has been present for ARRIVAL_DWELL_TIME after
+	// the absent to present edge. The lane re-arms once the sensor reads
+	// no marble again.
+	//
+	//A marble held by a busy gate that leaves the sensor before the gate
+	// frees is sorted as soon as the gate frees. If one is already waiting,
+	// the second is counted without being sorted, so the counts never miss
+	// a marble.
+	T_ErrorCode SortLane(int input, Marble &marble, Servo &servo, T_MarbleCount &laneCount)
+	{
+		T_ErrorCode errorCode = WAR_NO_MARBLE;
+		T_ArrivalDetector &arrival = this->Arrival[input];
+		T_Sample sample;
+		
+		//Sort a marble that left while the gate was busy
+		if((arrival.Waiting != NoMarble) && servo.IsReady())
+		{
+			servo.Actuate(arrival.Waiting);
+			UpdateCount(arrival.Waiting, laneCount);
+			arrival.Waiting = NoMarble;
+			errorCode = ERR_NO_ERROR;
+		}
+		
+		while(Sampler.GetSample(input, sample))
+		{
+			//Only look at the sensor when the filter has a new output
+			if(!Filters[input].Push(sample.Value))
+			{
+				continue;
+			}
+			
+			//Marble left the sensor: re-arm the lane
+			if(ClassifySample(Filters[input].GetOutput(), marble) == WAR_NO_MARBLE)
+			{
+				//Never drop a marble the gate was holding
+				if(arrival.Held != NoMarble)
+				{
+					if(arrival.Waiting == NoMarble)
+					{
+						arrival.Waiting = arrival.Held;
+					}
+					else
+					{
+						UpdateCount(arrival.Held, laneCount);
+					}
+					
+					arrival.Held = NoMarble;
+				}
+				
+				arrival.Present = false;
+				continue;
+			}
 			
-			//Write to EEPROM
-			eeprom_update_byte((uint8_t *)WHITE_COUNT_ADDR, (uint8_t)(this->MarbleCount.WhiteCount));
+			//Marble arrived
+			if(!arrival.Present)
+			{
+				arrival.Present = true;
+				arrival.Sorted = false;
+				arrival.Held = NoMarble;
+				arrival.ArrivalTime = sample.Timestamp;
+			}
+			
+			//Already sorted, or not settled on the sensor yet
+			if(arrival.Sorted || ((uint16_t)(sample.Timestamp - arrival.ArrivalTime) < ARRIVAL_DWELL_TIME))
+			{
+				continue;
+			}
+			
+			//Hold the marble until the gate is clear
+			if(!servo.IsReady())
+			{
+				arrival.Held = marble.GetMarbleType();
+				errorCode = WAR_SERVO_BUSY;
+				continue;
+			}
+			
+			//Start the actuation cycle; the return to nominal is
+			// completed by Timer 0 so sorting is never stalled
+			servo.Actuate(marble.GetMarbleType());
+			UpdateCount(marble.GetMarbleType(), laneCount);
+			arrival.Sorted = true;
+			arrival.Held = NoMarble;
+			errorCode = ERR_NO_ERROR;
 		}
 		
-		//Write time to EEPROM
-		eeprom_update_byte((uint8_t *)MIN_ADDR, (uint8_t)(this->MinutesElapsed));
-		eeprom_update_byte((uint8_t *)SEC_ADDR, (uint8_t)(this->SecondsElapsed));
+		return errorCode;
 	}
 	
 	public :
@@ -153,8 +257,6 @@ class Sorter
 	/************************************************************************/
 	bool MoreMarbles;						//Flag for whether there are more marbles to sort
 		
-	bool Flag;								//General flag
-	
 	bool WDTFlag;							//Watchdog Timer flag
 	
 	bool FlashLED;							//Flash Red LED flag
@@ -164,11 +266,12 @@ class Sorter
 	T_ButtonAction ResetButtonActon;		//Reset button action
 	T_ButtonAction StartStopButtonAction;	//Start/Stop button action
 	
-	T_State State;							//Sorter state: Idle, Sort, Recall, Reset
+	T_State State;							//Sorter state: Idle, Sort, Recall, Reset, Test, Error
 		
 	T_ErrorCode Error;						//Error code
 	
 	T_MarbleCount MarbleCount;				//Count for number of black, white, and total marbles sorted
+	T_MarbleCount LaneCount[SORTER_LANES];	//Count for each lane
 	
 	Marble MarbleZero;						//Marble at position zero
 	Marble MarbleOne;						//Marble at position one
@@ -176,10 +279,23 @@ class Sorter
 		
 	Servo ServoZero;						//Servo at position zero
 	Servo ServoOne;							//Servo at position one
+	
+	ADCSampler Sampler;						//Interrupt driven sensor sampler
+	CountLog Log;							//Wear leveled EEPROM count log
+	volatile bool CheckpointRequested;		//Whether the counts and time need to be logged
+	uint8_t CheckpointMarbles;				//Marbles sorted since the last checkpoint
+	uint8_t CheckpointSeconds;				//Seconds sorted since the last periodic checkpoint
+	
+	RunHistory History;						//Summaries of the last few runs
+	bool Running;							//Whether a run has been started and not ended
+	bool ResumeSort;						//Whether to go straight back to sorting
+	uint32_t RunStartTime;					//Run clock when the current run started
+	uint32_t RunStartBlackCount;			//Black count when the current run started
+	uint32_t RunStartWhiteCount;			//White count when the current run started
+	SampleFilter Filters[SORTER_LANES];		//Sensor filter for each lane
+	T_ArrivalDetector Arrival[SORTER_LANES];	//Marble arrival detector for each lane
 		
-	int MinutesElapsed;						//Minutes elapsed
-	int SecondsElapsed;						//Seconds elapsed
-	int TenthsOfSecondsElapsed;				//Tenths of seconds elapsed
+	volatile uint32_t RunTime;				//Time spent sorting in ms
 	
 	/************************************************************************/
 	/* Public Methods														*/
@@ -191,7 +307,6 @@ class Sorter
 	{
 		//Initialize sorter members
 		this->MoreMarbles = true;
-		this->Flag = false;
 		this->WDTFlag = false;
 		this->FlashLED = false;
 		this->State = IdleState;
@@ -199,9 +314,15 @@ class Sorter
 		this->MarbleCount.BlackCount = 0;
 		this->MarbleCount.WhiteCount = 0;
 		this->MarbleCount.TotalCount = 0;
-		this->MinutesElapsed = 0;
-		this->SecondsElapsed = 0;
-		this->TenthsOfSecondsElapsed = 0;
+		this->RunTime = 0;
+		this->CheckpointRequested = false;
+		this->CheckpointMarbles = 0;
+		this->CheckpointSeconds = 0;
+		this->Running = false;
+		this->ResumeSort = false;
+		this->RunStartTime = 0;
+		this->RunStartBlackCount = 0;
+		this->RunStartWhiteCount = 0;
 		
 		this->MarbleZero.SetIndex(0);
 		this->MarbleOne.SetIndex(1);
@@ -225,101 +346,229 @@ class Sorter
 	/************************************************************************/
 	void SetLEDColor(T_Color color)
 	{
-		//Clear the LED color
-		PORTD &= ~(LED_RED | LED_GREEN);
+		uint8_t leds = (color != Off) ? color : 0;
 		
-		//Set the LED color if necessary
-		if(color != Off)
+		//The servo multiplexer toggles a PORTD pin from its interrupt, so
+		// the read-modify-write must not be interrupted or its edge is lost
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 		{
-			PORTD |= color;
+			PORTD = (PORTD & ~(LED_RED | LED_GREEN)) | leds;
 		}
 	}
 	
 	/************************************************************************/
-	/* Perform one sorting cycle											*/
+	/* Sort every marble that has arrived since the last call				*/
 	/************************************************************************/
 	T_ErrorCode Sort(void)
 	{
-		/**********************************/
-		/* DEBUG: ONLY SORTING ONE MARBLE */
-		/**********************************/
 		//Declare error codes
-		T_ErrorCode errorCodeChannelZero = ERR_NO_ERROR;
-		//T_ErrorCode errorCodeChannelOne = ERR_NO_ERROR;
-			
-		//Check sensor 0
-		errorCodeChannelZero = CheckSensorOnChannel(CHANNEL_0, MarbleZero);
-			
-		//Check sensor 1
-		//errorCodeChannelOne = CheckSensorOnChannel(CHANNEL_1, MarbleOne);
+		T_ErrorCode errorCodeLaneZero = ERR_NO_ERROR;
+		T_ErrorCode errorCodeLaneOne = WAR_NO_MARBLE;
+		
+		//Sort lane zero
+		errorCodeLaneZero = SortLane(ADC_INPUT_LANE_0, MarbleZero, ServoZero, LaneCount[0]);
 		
-		//Update counts
-		UpdateCount(MarbleZero.GetMarbleType());
-		//UpdateCount(MarbleOne.GetMarbleType());
+#if SORTER_LANES > 1
+		//Sort lane one independently of lane zero
+		errorCodeLaneOne = SortLane(ADC_INPUT_LANE_1, MarbleOne, ServoOne, LaneCount[1]);
+#endif
 		
-		//IF SORTING ONE MARBLE
-		//Discern if channel detected no marble
-		if(errorCodeChannelZero == WAR_NO_MARBLE)
+		//Discern if every lane detected no marble
+		if((errorCodeLaneZero == WAR_NO_MARBLE) && (errorCodeLaneOne == WAR_NO_MARBLE))
 		{
-			//this->MoreMarbles = false;
 			return WAR_NO_MARBLE;
 		}
 		
-		//Marble was detected
-		//this->MoreMarbles = true;
+		//At least one lane is still waiting on its servo
+		if((errorCodeLaneZero == WAR_SERVO_BUSY) || (errorCodeLaneOne == WAR_SERVO_BUSY))
+		{
+			return WAR_SERVO_BUSY;
+		}
+		
+		return ERR_NO_ERROR;
+	}
+	
+	/************************************************************************/
+	/* Drop the samples queued while not sorting, so a run starts on		*/
+	/* fresh samples and overruns only count samples the sorter missed		*/
+	/************************************************************************/
+	void DiscardSamples(void)
+	{
+		T_Sample sample;
+		
+		for(int input = 0; input < SORTER_LANES; input++)
+		{
+			while(Sampler.GetSample(input, sample));
+		}
+	}
+	
+	/************************************************************************/
+	/* Clear the total and per-lane marble counts							*/
+	/************************************************************************/
+	void ClearCounts(void)
+	{
+		this->MarbleCount = T_MarbleCount();
+		
+		for(int lane = 0; lane < SORTER_LANES; lane++)
+		{
+			this->LaneCount[lane] = T_MarbleCount();
+		}
+	}
+	
+	/************************************************************************/
+	/* Get the time spent sorting in ms										*/
+	/************************************************************************/
+	uint32_t GetRunTime(void)
+	{
+		uint32_t runTime;
+		
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			runTime = this->RunTime;
+		}
+		
+		return runTime;
+	}
+	
+	/************************************************************************/
+	/* Copy what the user interface shows, so a frame is drawn from one		*/
+	/* consistent moment													*/
+	/************************************************************************/
+	void GetSnapshot(T_SorterSnapshot &snapshot)
+	{
+		snapshot.BlackCount = this->MarbleCount.BlackCount;
+		snapshot.WhiteCount = this->MarbleCount.WhiteCount;
+		snapshot.RunTime = GetRunTime();
+	}
+	
+	/************************************************************************/
+	/* Clear the time spent sorting											*/
+	/************************************************************************/
+	void ClearRunTime(void)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			this->RunTime = 0;
+		}
+	}
+	
+	/************************************************************************/
+	/* Request a checkpoint of the counts and time							*/
+	/************************************************************************/
+	void RequestCheckpoint(void)
+	{
+		this->CheckpointRequested = true;
+	}
+	
+	/************************************************************************/
+	/* Count a second of sorting towards the periodic checkpoint			*/
+	/* (called every 1s while sorting from Timer 0)							*/
+	/************************************************************************/
+	void TickCheckpoint(void)
+	{
+		if(++this->CheckpointSeconds >= CHECKPOINT_SECONDS)
+		{
+			this->CheckpointSeconds = 0;
+			this->CheckpointRequested = true;
+		}
+	}
+	
+	/************************************************************************/
+	/* Queue a requested checkpoint to the EEPROM log						*/
+	/************************************************************************/
+	//A checkpoint is requested every CHECKPOINT_MARBLES marbles, every
+	// CHECKPOINT_SECONDS seconds of sorting, when sorting stops, on a reset,
+	// and on the power fail signal. A power loss therefore loses at most
+	// CHECKPOINT_MARBLES - 1 marbles or CHECKPOINT_SECONDS seconds, plus
+	// whatever arrives while the previous record is still programming
+	// (requests made meanwhile are coalesced into the next record).
+	void FlushCheckpoint(void)
+	{
+		//A finished run goes out ahead of the checkpoint that follows it
+		this->History.Flush();
 		
-		//Set servo to sort marble based on type
-		ServoZero.SetServo(MarbleZero.GetMarbleType());
+		if(!this->CheckpointRequested || !eepromWriter.IsIdle())
+		{
+			return;
+		}
 		
-		//Delay and return to nominal
-		_delay_ms(500);
-		ServoZero.SetServo(NoMarble);
+		//Clear the request first so one made while queuing is not lost
+		this->CheckpointRequested = false;
+		this->CheckpointMarbles = 0;
 		
-		//Disable servo power
-		//Servo::Disable();
+		//A run that is still going is resumed after a power loss
+		T_State state = this->Running ? SortState : IdleState;
 		
-		//IF SORTING TWO MARBLES
-		//Discern if channel one or both channels detected no marble
-		/*
-		if(errorCodeChannelOne == WAR_NO_MARBLE)
+		if(!this->Log.Append(state, this->MarbleCount.BlackCount, this->MarbleCount.WhiteCount, GetRunTime()))
 		{
-			//One more marble to sort on channel zero
-			if(errorCodeChannelZero != WAR_NO_MARBLE)
-			{
-				Servo::Enable();
-				_delay_ms(10);
-				
-				ServoZero.SetServo(MarbleZero.GetMarbleType());
-				
-				_delay_ms(10);
-				Servo::Disable();
-				
-				this->MoreMarbles = false;
-				return WAR_NO_MARBLE;
-			}
-			
-			//No more marbles to sort
-			else
-			{
-				this->MoreMarbles = false;
-				return WAR_NO_MARBLE;	
-			}
-			
+			this->CheckpointRequested = true;
 		}
+	}
+	
+	/************************************************************************/
+	/* Restore the counts and time from the last checkpoint, returns the	*/
+	/* state the sorter was in when it was taken							*/
+	/************************************************************************/
+	T_State Restore(void)
+	{
+		T_CountRecord record;
 		
-		//Enable servo power supply
-		Servo::Enable();
-		_delay_ms(10);
+		if(!this->Log.GetNewest(record))
+		{
+			return IdleState;
+		}
 		
-		ServoZero.SetServo(MarbleZero.GetMarbleType());
-		ServoOne.SetServo(MarbleOne.GetMarbleType());
+		this->MarbleCount.BlackCount = record.BlackCount;
+		this->MarbleCount.WhiteCount = record.WhiteCount;
+		this->MarbleCount.TotalCount = record.BlackCount + record.WhiteCount;
 		
-		//Disable servo power supply
-		_delay_ms(10);
-		Servo::Disable();
-		*/
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			this->RunTime = record.RunTime;
+		}
 		
-		return ERR_NO_ERROR;
+		return (T_State)record.State;
+	}
+	
+	/************************************************************************/
+	/* Mark the start of a sorting run										*/
+	/************************************************************************/
+	void StartRun(void)
+	{
+		this->Running = true;
+		this->RunStartTime = GetRunTime();
+		this->RunStartBlackCount = this->MarbleCount.BlackCount;
+		this->RunStartWhiteCount = this->MarbleCount.WhiteCount;
+	}
+	
+	/************************************************************************/
+	/* Add the finished run to the history and checkpoint					*/
+	/************************************************************************/
+	void EndRun(T_ErrorCode fault)
+	{
+		this->Running = false;
+		
+		//A marble still waiting on a gate is counted, not dropped
+		for(int lane = 0; lane < SORTER_LANES; lane++)
+		{
+			UpdateCount(this->Arrival[lane].Waiting, this->LaneCount[lane]);
+			this->Arrival[lane].Waiting = NoMarble;
+		}
+		
+		this->History.Add(this->RunStartTime, GetRunTime(),
+						  this->MarbleCount.BlackCount - this->RunStartBlackCount,
+						  this->MarbleCount.WhiteCount - this->RunStartWhiteCount, fault);
+		
+		RequestCheckpoint();
+	}
+	
+	/************************************************************************/
+	/* Advance the servo actuation cycles (called every 10ms)				*/
+	/************************************************************************/
+	void TickServos(void)
+	{
+		ServoZero.Tick();
+		ServoOne.Tick();
 	}
 	
 	/************************************************************************/
@@ -327,7 +576,16 @@ class Sorter
 	/************************************************************************/
 	T_ErrorCode CheckForMoreMarbles(void)
 	{
-		return CheckSensorOnChannel(CHANNEL_0, NullMarble);
+		//Only peek at the latest samples so the sorter's queues are untouched
+#if SORTER_LANES > 1
+		//Marbles are left if either lane still sees one
+		if(ClassifySample(Sampler.GetLatest(ADC_INPUT_LANE_1), NullMarble) != WAR_NO_MARBLE)
+		{
+			return ERR_NO_ERROR;
+		}
+#endif
+		
+		return ClassifySample(Sampler.GetLatest(ADC_INPUT_LANE_0), NullMarble);
 	}
 	
 	/************************************************************************/
@@ -384,4 +642,4 @@ class Sorter
 };
 
 
-#endif /* SORTER_H_ */
\ No newline at end of file
+#endif /* SORTER_H_ */
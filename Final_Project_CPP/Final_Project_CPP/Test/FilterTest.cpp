@@ -0,0 +1,200 @@
+/************************************************************************/
+/* File: FilterTest.cpp													*/
+/* Author: Joe Gibson and Jesse Millwood								*/
+/* Date: 11/5/13														*/
+/* Course: EGR 326														*/
+/* Description: FilterTest.cpp checks the SampleFilter stages on known	*/
+/*				sequences and benchmarks it on a host PC. It is not		*/
+/*				part of the AVR project. Build and run it with:			*/
+/*																		*/
+/*				g++ -O2 -I.. FilterTest.cpp -o FilterTest				*/
+/*				g++ -O2 -I.. -DFILTER_MODE=FILTER_BOXCAR				*/
+/*					FilterTest.cpp -o FilterTest						*/
+/*																		*/
+/*				The expected values are worked out for the default		*/
+/*				median, oversample, window and EMA settings				*/
+/*																		*/
+/* Grand Valley State University, 2013									*/
+/************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "Filter.h"
+
+#if !FILTER_MEDIAN3 || (FILTER_OVERSAMPLE != 4) || (FILTER_WINDOW_LEN != 4) || (FILTER_EMA_SHIFT != 1)
+#error "The expected values are for the default filter settings"
+#endif
+
+#define BENCHMARK_SAMPLES 10000000UL	//Raw samples pushed by the benchmark
+
+static int Failures = 0;
+
+/************************************************************************/
+/* Report a check that failed											*/
+/************************************************************************/
+static void Check(bool passed, const char *name, int index, int value, int expected)
+{
+	if(!passed)
+	{
+		printf("FAIL %s [%d]: got %d, expected %d\n", name, index, value, expected);
+		Failures++;
+	}
+}
+
+/************************************************************************/
+/* Push samples, returning the outputs produced							*/
+/************************************************************************/
+static int PushAll(SampleFilter &filter, const uint8_t *samples, int count, uint8_t *outputs)
+{
+	int produced = 0;
+
+	for(int i = 0; i < count; i++)
+	{
+		if(filter.Push(samples[i]))
+		{
+			outputs[produced++] = filter.GetOutput();
+		}
+	}
+
+	return produced;
+}
+
+/************************************************************************/
+/* One output for every FILTER_OVERSAMPLE samples						*/
+/************************************************************************/
+static void TestDecimation(void)
+{
+	SampleFilter filter;
+
+	for(int i = 1; i <= 4 * FILTER_OVERSAMPLE; i++)
+	{
+		bool ready = filter.Push(100);
+
+		Check(ready == ((i % FILTER_OVERSAMPLE) == 0), "decimation", i, ready, !ready);
+	}
+}
+
+/************************************************************************/
+/* Single sample spikes never reach the output							*/
+/************************************************************************/
+static void TestMedian(void)
+{
+	static const uint8_t samples[] =
+	{
+		100, 100, 100, 100,
+		100, 255, 100, 100,
+		100, 100,   0, 100,
+		255, 100, 100,   0,
+		100, 100, 100, 100
+	};
+	uint8_t outputs[sizeof(samples)];
+	SampleFilter filter;
+
+	int produced = PushAll(filter, samples, sizeof(samples), outputs);
+
+	Check(produced == 5, "median count", 0, produced, 5);
+
+	for(int i = 0; i < produced; i++)
+	{
+		Check(outputs[i] == 100, "median", i, outputs[i], 100);
+	}
+}
+
+/************************************************************************/
+/* Step from 0 to 200: the median delays the step by one sample, so the	*/
+/* decimated values are 0, 150, 200, 200, ...							*/
+/************************************************************************/
+static void TestStep(void)
+{
+	uint8_t samples[6 * FILTER_OVERSAMPLE];
+	uint8_t outputs[6];
+	SampleFilter filter;
+
+#if FILTER_MODE == FILTER_BOXCAR
+	//Window of 4 primed with 0
+	static const uint8_t expected[6] = { 0, 37, 87, 137, 187, 200 };
+#else
+	//Average += (value - Average) / 2, rounded to the nearest whole value
+	static const uint8_t expected[6] = { 0, 75, 138, 169, 184, 192 };
+#endif
+
+	for(int i = 0; i < (int)sizeof(samples); i++)
+	{
+		samples[i] = (i < FILTER_OVERSAMPLE) ? 0 : 200;
+	}
+
+	int produced = PushAll(filter, samples, sizeof(samples), outputs);
+
+	Check(produced == 6, "step count", 0, produced, 6);
+
+	for(int i = 0; i < produced; i++)
+	{
+		Check(outputs[i] == expected[i], "step", i, outputs[i], expected[i]);
+	}
+}
+
+/************************************************************************/
+/* Reset forgets the old samples and primes on the next one				*/
+/************************************************************************/
+static void TestReset(void)
+{
+	SampleFilter filter;
+
+	for(int i = 0; i < 8 * FILTER_OVERSAMPLE; i++)
+	{
+		filter.Push(200);
+	}
+
+	filter.Reset();
+
+	for(int i = 0; i < FILTER_OVERSAMPLE; i++)
+	{
+		filter.Push(50);
+	}
+
+	Check(filter.GetOutput() == 50, "reset", 0, filter.GetOutput(), 50);
+}
+
+/************************************************************************/
+/* Time the filter on a noisy square wave								*/
+/************************************************************************/
+static void Benchmark(void)
+{
+	SampleFilter filter;
+	uint32_t noise = 1;
+	uint32_t outputs = 0;
+	clock_t start = clock();
+
+	for(uint32_t i = 0; i < BENCHMARK_SAMPLES; i++)
+	{
+		//Marble on the sensor for 64 samples out of every 128, plus noise
+		noise = noise * 1103515245UL + 12345;
+
+		uint8_t sample = ((i & 64) ? 60 : 200) + ((noise >> 16) & 15);
+
+		if(filter.Push(sample))
+		{
+			outputs += filter.GetOutput();
+		}
+	}
+
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("benchmark: %lu samples in %.3fs, %.1fns per sample (checksum %lu)\n",
+		   BENCHMARK_SAMPLES, seconds, (seconds * 1e9) / BENCHMARK_SAMPLES, (unsigned long)outputs);
+}
+
+int main(void)
+{
+	TestDecimation();
+	TestMedian();
+	TestStep();
+	TestReset();
+
+	printf("%s filter: %s\n", (FILTER_MODE == FILTER_BOXCAR) ? "boxcar" : "EMA", Failures ? "FAILED" : "passed");
+
+	Benchmark();
+
+	return Failures ? 1 : 0;
+}
@@ -20,17 +20,61 @@
 #include "Global.h"					//Global header file
 #include "Marble.h"					//Marble class definition
 #include "Servo.h"					//Servo class definition
+#include "ADCSampler.h"				//ADCSampler class definition
+#include "Filter.h"					//SampleFilter class definition
+#include "Classifier.h"				//Marble class lookup table
+#include "EEPROMWriter.h"			//EEPROMWriter class definition
+#include "CountLog.h"				//CountLog class definition
+#include "RunHistory.h"				//RunHistory class definition
 #include "Sorter.h"					//Sorter class definition
+#include "Display.h"					//Display class definition
+#include "Screens.h"				//Screen text and layouts in flash
+#include "Scheduler.h"				//Scheduler class definition
 
 //Create the LCD object
 LiquidCrystal_I2C lcd(I2C_ADDRESS, EN, RW, RS, D4, D5, D6, D7, BL, BL_POL);
 
+//Create the display object, which everything draws into
+Display display(lcd);
+
+#if SERVO_DRIVER == SERVO_DRIVER_MUX
+//Create the servo multiplexer object
+ServoMux servoMux;
+#endif
+
+//Create the EEPROM writer object
+EEPROMWriter eepromWriter;
+
 //Create the sorter object
 Sorter sorter;
 
+volatile bool FrameDue = false;			//Set by Timer 0 every UI_FRAME_MS
+
 int ResetCount = 0;
 int StartStopCount = 0;
 
+//Task table, highest priority first; the scheduler fills in the rest
+T_Task Tasks[] =
+{
+	//Task			Period (ms)			Deadline (ms)		Release	Misses
+	{TaskSort,		0,					0,					0,		0},
+	{TaskSense,		TASK_SENSE_MS,		10,					0,		0},
+	{TaskInput,		TASK_INPUT_MS,		20,					0,		0},
+	{TaskUI,		TASK_UI_MS,			50,					0,		0},
+	{TaskPersist,	TASK_PERSIST_MS,	100,				0,		0},
+	{TaskTelemetry,	TASK_TELEMETRY_MS,	TASK_TELEMETRY_MS,	0,		0}
+};
+
+//Create the scheduler object
+Scheduler scheduler(Tasks, sizeof(Tasks) / sizeof(Tasks[0]));
+
+//Timed steps of the input task
+uint16_t StepTime = 0;					//Scheduler time the current step started
+uint8_t Step = 0;						//Steps left in the "No More Marbles" blink
+uint8_t ResetDots = 0;					//Dots printed after "Reset"
+int RecallPage = 0;						//Recall page on the screen
+bool RecallPending = false;				//Whether the recall page still has to be drawn
+
 /************************************************************************/
 /* SETUP AND LOOP														*/
 /************************************************************************/
@@ -53,6 +97,10 @@ void setup(void)
 	
 	//Enable global interrupts
 	sei();
+	
+	//Draw the idle screen and release every task
+	PrintIdleScreen();
+	scheduler.Start();
 }
 
 /************************************************************************/
@@ -60,278 +108,310 @@ void setup(void)
 /************************************************************************/
 void loop(void)
 {	
-	static char tmp[LINE_LEN];
-	static char dots = 0;
-	static bool printIdleScreen = true;
+	//Run every released task once; nothing in a task waits
+	scheduler.RunOnce();
+}
+
+/************************************************************************/
+/* TASKS																*/
+/************************************************************************/
+/************************************************************************/
+/* Sort Task: sort every marble as soon as it arrives					*/
+/************************************************************************/
+void TaskSort(void)
+{
+	if(sorter.State == SortState)
+	{
+		sorter.Sort();
+	}
+}
+
+/************************************************************************/
+/* Sense Task: end the run once the marbles run out, and keep the		*/
+/* sample queues fresh while not sorting								*/
+/************************************************************************/
+void TaskSense(void)
+{
+	if(sorter.State != SortState)
+	{
+		sorter.DiscardSamples();
+		return;
+	}
 	
-	//Print the idle screen if necessary
-	if(printIdleScreen)
+	if(!sorter.WDTFlag)
 	{
-		PrintIdleScreen();
-		printIdleScreen = false;
+		return;
 	}
 	
-	//Reset WDT
-	wdt_reset();
+	//Clear WDTFlag
+	sorter.WDTFlag = false;
 	
-	/********/
-	/* Sort */
-	/********/
-	if((sorter.GetStartStopButtonAction() == Press) && (sorter.State == IdleState))
-	{	
+	//Check number of marbles sorted
+	if(sorter.MarbleCount.TotalCount >= SORT_THRESHOLD)
+	{
+		//Sorter was able to sort 10 marbles
+		sorter.SetLEDColor(Red);
+		sorter.EndRun(ERR_NO_ERROR);
+		
 		sorter.ButtonActionCompleted();
+		sorter.State = IdleState;
+		PrintIdleScreen();
+	}
+	else
+	{
+		sorter.EndRun(ERR_WDT_TIMEOUT);
 		
-		//Check if there are more marbles to be sorted
-		if(sorter.MoreMarbles)
-		{
-			sorter.State = SortState;
-			sorter.SetLEDColor(Green);
-			
-			lcd.clear();
-			lcd.home();
-			lcd.print("Sorting");
-			
-			while((sorter.GetStartStopButtonAction() != Press) && !sorter.WDTFlag)
-			{	
-				//Check for 100ms sorter flag
-				if(sorter.Flag)
+		//Sorter was not able to sort 10 marbles
+		//Flash the LED Red until the start/stop 
+		// button is pressed to acknowledge
+		sorter.ButtonActionCompleted();
+		sorter.State = ErrorState;
+		sorter.FlashLED = true;
+		display.PrintScreen_P(ErrorScreen);
+	}
+}
+
+/************************************************************************/
+/* Input Task: act on the buttons and step the timed sequences			*/
+/************************************************************************/
+void TaskInput(void)
+{
+	T_ButtonAction startStopAction = sorter.GetStartStopButtonAction();
+	T_ButtonAction resetAction = sorter.GetResetButtonAction();
+	uint16_t elapsed = scheduler.Now() - StepTime;
+	
+	switch(sorter.State)
+	{
+		/********/
+		/* Idle */
+		/********/
+		case IdleState:
+			//Blink "No More Marbles"; actions wait for the blink to finish
+			if(Step)
+			{
+				if(elapsed >= NO_MARBLES_BLINK_MS)
 				{
-					//Clear sort flag
-					sorter.Flag = false;
-					
-					//Complete one sort cycle
-					sorter.Sort();
+					StepTime += NO_MARBLES_BLINK_MS;
+					Step--;
 					
-					//Print dot animation
-					lcd.setCursor(7, LINE_1);
+					sorter.SetLEDColor((Step & 1) ? Red : Off);
 					
-					switch(dots++)
+					if(Step == 0)
 					{
-						case 0:
-							lcd.print("   ");
-							break;
-						case 1:
-							lcd.print(".  ");
-							break;
-						case 2:
-							lcd.print(".. ");
-							break;
-						case 3:
-							lcd.print("...");
-							dots = 0;
-							break;
+						ClearLine(LINE_4);
 					}
-					
-					//Update screen
-					lcd.setCursor(0, LINE_3);
-					sprintf(tmp, "W: %03d        B: %03d", sorter.MarbleCount.WhiteCount, sorter.MarbleCount.BlackCount);
-					lcd.print(tmp);
-
-					lcd.setCursor(0, LINE_4);	
-					sprintf(tmp, "     %02d:%02d:%d00    ", sorter.MinutesElapsed, sorter.SecondsElapsed, sorter.TenthsOfSecondsElapsed);
-					lcd.print(tmp);
-				}
-				
-				else
-				{
-					_delay_us(10);
 				}
+				break;
 			}
 			
-			//Exited due to WDT flag
-			if(sorter.WDTFlag)
+			//Sort
+			if((startStopAction == Press) || sorter.ResumeSort)
 			{
-				//Clear WDTFlag
-				sorter.WDTFlag = false;
+				sorter.ButtonActionCompleted();
+				sorter.ResumeSort = false;
 				
-				//Check number of marbles sorted
-				if(sorter.MarbleCount.TotalCount >= SORT_THRESHOLD)
+				//Check if there are more marbles to be sorted
+				if(sorter.MoreMarbles)
 				{
-					//Sorter was able to sort 10 marbles
-					sorter.SetLEDColor(Red);
+					sorter.State = SortState;
+					sorter.SetLEDColor(Green);
+					sorter.StartRun();
+					
+					display.PrintScreen_P(SortScreen);
+					PrintSortFrame();
 				}
+				
+				//There are no marbles to sort: on, off, on, off
 				else
 				{
-					//Sorter was not able to sort 10 marbles
-					//Flash the LED Red and wait until start/stop 
-					// button is pressed to acknowledge
-					sorter.FlashLED = true;
-					lcd.clear();
-					lcd.setCursor(0, LINE_2);
-					lcd.print("        ERROR       ");
+					display.SetCursor(0, LINE_4);
+					display.Print_P(TextNoMarbles);
 					
-					lcd.setCursor(0, LINE_3);
-					lcd.print("PRESS S to Continue");
-					
-					while(sorter.GetStartStopButtonAction() != Press)
-					{
-						_delay_us(10);
-						//wdt_reset();
-					}
-					
-					sorter.ButtonActionCompleted();
-					
-					sorter.SetLEDColor(Off);
-					sorter.FlashLED = false;
+					sorter.SetLEDColor(Red);
+					StepTime = scheduler.Now();
+					Step = 3;
 				}
 			}
 			
-			//Exited due to pressing start/stop
-			else
+			//Recall Information
+			else if(startStopAction == Hold)
 			{
 				sorter.ButtonActionCompleted();
-				sorter.SetLEDColor(Yellow);
+				sorter.State = RecallState;
+				
+				RecallPage = 0;
+				RecallPending = !PrintRecallPage(RecallPage);
 			}
 			
-			//Return to idle state
-			sorter.ButtonActionCompleted();
-			sorter.State = IdleState;
-			printIdleScreen = true;
-		}
-		
-		//There are no marbles to sort
-		else
-		{
-			lcd.setCursor(0, LINE_4);
-			lcd.print("No More Marbles");
-			
-			sorter.SetLEDColor(Red);
-			_delay_ms(200);
-			sorter.SetLEDColor(Off);
-			_delay_ms(200);
-			sorter.SetLEDColor(Red);
-			_delay_ms(200);
-			sorter.SetLEDColor(Off);
+			//Reset Information
+			else if(resetAction == Press)
+			{
+				sorter.ButtonActionCompleted();
+				sorter.State = ResetState;
+				
+				ClearLine(LINE_4);
+				display.SetCursor(0, LINE_4);
+				display.Print_P(TextReset);
+				
+				StepTime = scheduler.Now();
+				ResetDots = 0;
+			}
 			
-			ClearLine(LINE_4);
-		}
-	}
-	
-	/**********************/
-	/* Recall Information */
-	/**********************/
-	if((sorter.GetStartStopButtonAction() == Hold) && (sorter.State == IdleState))
-	{
-		static uint8_t min = 0;
-		static uint8_t sec = 0;
-		static uint8_t whiteCount = 0;
-		static uint8_t blackCount = 0;
-		sorter.ButtonActionCompleted();
-		sorter.State = RecallState;
-		
-		lcd.clear();
-		lcd.home();
-		lcd.print("Recall Information");
-		
-		min = eeprom_read_byte((uint8_t *)MIN_ADDR);
-		sec = eeprom_read_byte((uint8_t *)SEC_ADDR);
-		whiteCount = eeprom_read_byte((uint8_t *)WHITE_COUNT_ADDR);
-		blackCount = eeprom_read_byte((uint8_t *)BLACK_COUNT_ADDR);
-		
-		if(min == 0xFF)
-		{
-			min = 0;
-		}
-		if(sec == 0xFF)
-		{
-			sec = 0;
-		}
-		if(whiteCount == 0xFF)
-		{
-			whiteCount = 0;
-		}
-		if(blackCount == 0xFF)
-		{
-			blackCount = 0;
-		}
-		
-		lcd.setCursor(0, LINE_2);
-		sprintf(tmp, "Time: %02d:%02d:000", min, sec);
-		lcd.print(tmp);
+			//TEST STATE
+			else if(resetAction == Hold)
+			{
+				sorter.ButtonActionCompleted();
+				sorter.State = TestState;
+				
+				display.PrintScreen_P(TestScreen);
+				PrintTelemetry();
+			}
+			break;
 		
-		lcd.setCursor(0, LINE_3);
-		sprintf(tmp, "White Count: %03d", whiteCount);
-		lcd.print(tmp);
+		/********/
+		/* Sort */
+		/********/
+		case SortState:
+			//Stopped by pressing start/stop
+			if(startStopAction == Press)
+			{
+				sorter.ButtonActionCompleted();
+				sorter.SetLEDColor(Yellow);
+				sorter.EndRun(ERR_NO_ERROR);
+				
+				//Return to idle state
+				sorter.State = IdleState;
+				PrintIdleScreen();
+			}
+			break;
 		
-		lcd.setCursor(0, LINE_4);
-		sprintf(tmp, "Black Count: %03d", blackCount);
-		lcd.print(tmp);
+		/*********/
+		/* Error */
+		/*********/
+		case ErrorState:
+			//Wait until start/stop button is pressed to acknowledge
+			if(startStopAction == Press)
+			{
+				sorter.ButtonActionCompleted();
+				sorter.SetLEDColor(Off);
+				sorter.FlashLED = false;
+				
+				//Return to idle state
+				sorter.State = IdleState;
+				PrintIdleScreen();
+			}
+			break;
 		
-		//Wait for start/stop button to be held
-		while(sorter.GetStartStopButtonAction() != Hold)
-		{
-			_delay_us(10);
-			wdt_reset();	
-		}
+		/**********************/
+		/* Recall Information */
+		/**********************/
+		case RecallState:
+			//Page through the checkpoint, the runs, and the totals
+			if(startStopAction == Press)
+			{
+				sorter.ButtonActionCompleted();
+				
+				RecallPage = (RecallPage + 1) % (sorter.History.GetTotals().Runs + 2);
+				RecallPending = !PrintRecallPage(RecallPage);
+			}
+			
+			//Wait for start/stop button to be held
+			else if(startStopAction == Hold)
+			{
+				sorter.ButtonActionCompleted();
+				
+				//Return to idle state
+				sorter.State = IdleState;
+				PrintIdleScreen();
+			}
+			
+			//Draw a run once the EEPROM writer is done with it
+			else if(RecallPending)
+			{
+				RecallPending = !PrintRecallPage(RecallPage);
+			}
+			break;
 		
-		sorter.ButtonActionCompleted();
+		/*********************/
+		/* Reset Information */
+		/*********************/
+		case ResetState:
+			//A dot every RESET_DOT_MS, then clear everything
+			if(ResetDots < 3)
+			{
+				if(elapsed >= RESET_DOT_MS)
+				{
+					StepTime += RESET_DOT_MS;
+					display.Write('.');
+					
+					if(++ResetDots == 3)
+					{
+						sorter.ClearRunTime();
+						sorter.ClearCounts();
+						sorter.SetLEDColor(Off);
+						sorter.RequestCheckpoint();
+					}
+				}
+			}
+			
+			//Leave "Reset..." up for a moment
+			else if(elapsed >= RESET_HOLD_MS)
+			{
+				//Return to idle state
+				sorter.State = IdleState;
+				PrintIdleScreen();
+			}
+			break;
 		
-		//Return to idle state
-		sorter.State = IdleState;
-		printIdleScreen = true;
+		/**************/
+		/* TEST STATE */
+		/**************/
+		case TestState:
+			//Wait for reset button to be held
+			if(resetAction == Hold)
+			{
+				sorter.ButtonActionCompleted();
+				
+				//Return to idle state
+				sorter.State = IdleState;
+				PrintIdleScreen();
+			}
+			break;
 	}
-	
-	/*********************/
-	/* Reset Information */
-	/*********************/
-	if((sorter.GetResetButtonAction() == Press) && (sorter.State == IdleState))
+}
+
+/************************************************************************/
+/* UI Task: draw the sort screen at the frame rate and send a few		*/
+/* changed cells to the LCD; a slow LCD drops frames, not marbles		*/
+/************************************************************************/
+void TaskUI(void)
+{
+	if((sorter.State == SortState) && FrameDue)
 	{
-		sorter.ButtonActionCompleted();
-		sorter.State = ResetState;
-		
-		ClearLine(LINE_4);
-		lcd.setCursor(0, LINE_4);
-		lcd.print("Reset");
-		
-		for(int i = 0; i < 3; i++)
-		{
-			_delay_ms(200);
-			lcd.print(".");
-		}
-		
-		sorter.SecondsElapsed = 0;
-		sorter.MinutesElapsed = 0;
-		
-		sorter.MarbleCount.WhiteCount = 0;
-		sorter.MarbleCount.BlackCount = 0;
-		sorter.MarbleCount.TotalCount = 0;
-		sorter.SetLEDColor(Off);
-		eeprom_update_byte((uint8_t *)MIN_ADDR, 0);
-		eeprom_update_byte((uint8_t *)SEC_ADDR, 0);
-		eeprom_update_byte((uint8_t *)WHITE_COUNT_ADDR, 0);
-		eeprom_update_byte((uint8_t *)BLACK_COUNT_ADDR, 0);
-		
-		_delay_ms(1000);
-		
-		//Return to idle state
-		sorter.State = IdleState;
-		printIdleScreen = true;
+		FrameDue = false;
+		PrintSortFrame();
 	}
 	
-	/**************/
-	/* TEST STATE */
-	/**************/
-	if((sorter.GetResetButtonAction() == Hold) && (sorter.State == IdleState))
+	display.Render(UI_RENDER_CELLS);
+}
+
+/************************************************************************/
+/* Persistence Task: log any requested checkpoint in the background		*/
+/************************************************************************/
+void TaskPersist(void)
+{
+	sorter.FlushCheckpoint();
+}
+
+/************************************************************************/
+/* Telemetry Task: show the sampler and scheduler statistics on the		*/
+/* test screen															*/
+/************************************************************************/
+void TaskTelemetry(void)
+{
+	if(sorter.State == TestState)
 	{
-		sorter.ButtonActionCompleted();
-		sorter.State = TestState;
-		
-		lcd.clear();
-		lcd.home();
-		lcd.print("TEST STATE");
-		
-		//Wait for reset button to be held
-		while(sorter.GetResetButtonAction() != Hold)
-		{
-			_delay_us(10);
-			wdt_reset();
-		}
-		
-		sorter.ButtonActionCompleted();
-		
-		//Return to idle state
-		sorter.State = IdleState;
-		printIdleScreen = true;
+		PrintTelemetry();
 	}
 }
 
@@ -359,13 +439,14 @@ ISR(WDT_vect)
 /************************************************************************/
 ISR(TIMER0_COMPA_vect)
 {
-	static int count = 0;
 	static int wdtCount = 0;
 	static int timeCount = 0;
+	static int flashCount = 0;
+	static int frameCount = 0;
 	static bool toggle = 0;
 	
-	//Increment the count
-	count++;
+	//Advance the servo actuation cycles
+	sorter.TickServos();
 	
 	//Increment the WDT count
 	wdtCount++;
@@ -374,6 +455,7 @@ ISR(TIMER0_COMPA_vect)
 	if(sorter.State == SortState)
 	{
 		timeCount++;
+		sorter.RunTime += 10;
 	}
 	
 	//2s set flag to mimic WDT
@@ -394,40 +476,25 @@ ISR(TIMER0_COMPA_vect)
 		}
 	}
 	
-	//100 x 10ms for 1s delay
-	if(count >= 100)
+	//Sort screen frame
+	if(++frameCount >= (UI_FRAME_MS / 10))
 	{
-		count = 0;
-		sorter.Flag = true; //Set flag
+		frameCount = 0;
+		FrameDue = true;
 	}
 	
-	//Keep track of seconds and minutes and flash LED if necessary
+	//Count each second of sorting towards the periodic checkpoint; the
+	// run clock itself is RunTime
 	if(timeCount >= 100)
 	{
 		timeCount = 0;
-		
-		//sorter.TenthsOfSecondsElapsed ++;
-		
-		sorter.SecondsElapsed++;
-		
-		/*
-		if(sorter.TenthsOfSecondsElapsed == 10)
-		{
-			sorter.SecondsElapsed++;
-			
-			lcd.setCursor(0, LINE_2);
-			lcd.print(sorter.SecondsElapsed);
-			
-			sorter.TenthsOfSecondsElapsed = 0;
-		}
-		*/
-		
-		if(sorter.SecondsElapsed >= 60)
-		{
-			sorter.MinutesElapsed++;
-			sorter.SecondsElapsed = 0;
-		}
-		
+		sorter.TickCheckpoint();
+	}
+	
+	//Flash LED if necessary, in any state
+	if(++flashCount >= 100)
+	{
+		flashCount = 0;
 		toggle ^= true;
 		
 		if(sorter.FlashLED)
@@ -453,6 +520,10 @@ ISR(TIMER2_COMPA_vect)
 	static int startStopCount = 0;
 	static int noMoreMarblesCount = 0;
 	
+	//Advance the sample timestamp and the task time
+	sorter.Sampler.Tick();
+	scheduler.Tick();
+	
 	//Check if marble present
 	if(sorter.CheckForMoreMarbles() == WAR_NO_MARBLE)
 	{
@@ -545,6 +616,46 @@ ISR(TIMER2_COMPA_vect)
 	}
 }
 
+/************************************************************************/
+/* ADC Conversion Complete												*/
+/************************************************************************/
+ISR(ADC_vect)
+{
+	sorter.Sampler.OnConversionComplete();
+}
+
+/************************************************************************/
+/* EEPROM Ready															*/
+/************************************************************************/
+ISR(EE_READY_vect)
+{
+	eepromWriter.OnReady();
+}
+
+#if POWER_FAIL_SENSE
+/************************************************************************/
+/* Pin Change 1 (power fail input)										*/
+/************************************************************************/
+ISR(PCINT1_vect)
+{
+	//Save the run while the supply holds up
+	if(!(PINC & POWER_FAIL_IN))
+	{
+		sorter.RequestCheckpoint();
+	}
+}
+#endif
+
+#if SERVO_DRIVER == SERVO_DRIVER_MUX
+/************************************************************************/
+/* Timer 1 Compare A (servo multiplexer edges)							*/
+/************************************************************************/
+ISR(TIMER1_COMPA_vect)
+{
+	servoMux.OnCompare();
+}
+#endif
+
 /************************************************************************/
 /* GLOBAL FUNCTIONS														*/
 /************************************************************************/
@@ -559,7 +670,7 @@ void InitPortDirections(void)
 	DDRD = 0x00;
 	
 	//PORTB OUTPUTS
-	DDRB |= SWITCH_S0 | SWITCH_S1 | SENSOR_EN | SERVO_PWM;
+	DDRB |= SENSOR_EN | SERVO_PWM | SERVO_PWM_1;
 	
 	//PORTD OUTPUTS
 	DDRD |= SERVO_EN | LED_RED | LED_GREEN;
@@ -572,6 +683,12 @@ void InitPortDirections(void)
 	
 	//Enable pull up resistors
 	PORTD |= (START_STOP_BTN | RESET_BTN);
+	
+#if POWER_FAIL_SENSE
+	//Power fail input with pull up
+	DDRC &= ~POWER_FAIL_IN;
+	PORTC |= POWER_FAIL_IN;
+#endif
 }
 
 /************************************************************************/
@@ -587,12 +704,18 @@ void InitTimers(void)
 	TIMSK0 = _BV(OCIE0A);			//Enable compare interrupt
 	OCR0A = CYCLES_1;				//Set OCR0A to the correct number of cycles
 	
-	//Configure Timer 1 for Phase-Correct PWM mode and 20ms period
-	TCCR1A = _BV(COM1B1) |  _BV(WGM10) | _BV(WGM11);	//Clear PB2 on rise, set on fall
+#if SERVO_DRIVER == SERVO_DRIVER_MUX
+	//Configure Timer 1 to free run and pulse the servos from its compare interrupt
+	servoMux.Start();
+#else
+	//Configure Timer 1 for Phase-Correct PWM mode with ICR1 as TOP and 20ms period
+	TCCR1A = _BV(COM1A1) | _BV(COM1B1) | _BV(WGM11);	//Clear PB1 and PB2 on rise, set on fall
 	TCCR1B = _BV(CS11) | _BV(WGM13);					//1:8 Prescaler
 	
-	OCR1A = PERIOD_CNT >> 1;							//Set OCR1A to Period/2
+	ICR1 = PERIOD_CNT >> 1;								//Set ICR1 to Period/2
+	OCR1A = (PERIOD_CNT / 20) >> 1;						//Initially set OCR1A to 1ms on time / 2
 	OCR1B = (PERIOD_CNT / 20) >> 1;						//Initially set OCR1B to 1ms on time / 2
+#endif
 	
 	//Configure Timer 2 to delay 1ms
 	TCCR2A = _BV(WGM21);			//CTC Mode
@@ -610,9 +733,12 @@ void InitADC(void)
 {
 	//Configure ADC
 	ADMUX = _BV(REFS0) | _BV(ADLAR); //5V Vref, Left aligned, Channel 0
-	ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);	//Enable ADC, Start Conversion,
-																						//	Auto-Start, 1:128 Pre-scaler
-	ADCSRB = 0; //Free Run Mode
+	ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);	//Enable ADC, Enable Interrupt,
+																			//	1:128 Pre-scaler
+	ADCSRB = 0;
+	
+	//Start the first conversion; the ADC interrupt chains the rest
+	sorter.Sampler.Start();
 }
 
 /************************************************************************/
@@ -620,7 +746,21 @@ void InitADC(void)
 /************************************************************************/
 void InitEEPROM(void)
 {
-	;	
+	//Find the newest record in the count log and the newest run
+	sorter.Log.Open();
+	sorter.History.Open();
+	
+	//Pick up where the last checkpoint left off
+	if(sorter.Restore() == SortState)
+	{
+		sorter.ResumeSort = RESUME_ON_BOOT;
+	}
+	
+#if POWER_FAIL_SENSE
+	//Checkpoint when the power fail input falls
+	PCMSK1 |= _BV(PCINT11);
+	PCICR |= _BV(PCIE1);
+#endif
 }
 
 /************************************************************************/
@@ -678,23 +818,31 @@ void InitLCD(void)
 	
 	lcd.backlight();
 	
-	lcd.clear();
-	lcd.home();
-	lcd.print("Gibson-Millwood");
+	//Get back to sorting without the splash screen
+	if(sorter.ResumeSort)
+	{
+		return;
+	}
+	
+	display.Clear();
+	display.Print_P(TextTitle);
+	display.Render();
 	_delay_ms(1000);
 	
-	lcd.setCursor(0, LINE_2);
-	lcd.print("Marble Sorter");
+	display.SetCursor(0, LINE_2);
+	display.Print_P(TextName);
+	display.Render();
 	_delay_ms(1000);
 	
-	lcd.setCursor(0, LINE_3);
-	lcd.print("V1.00");
+	display.SetCursor(0, LINE_3);
+	display.Print_P(TextVersion);
+	display.Render();
 	_delay_ms(1000);
 	
 	LoadingBar();
 	
-	lcd.clear();
-	lcd.home();
+	display.Clear();
+	display.Render();
 }
 
 /************************************************************************/
@@ -702,15 +850,16 @@ void InitLCD(void)
 /************************************************************************/
 void LoadingBar(void)
 {
-	lcd.setCursor(0, LINE_4);
+	display.SetCursor(0, LINE_4);
 	
 	for(int i = 0; i < LINE_LEN; i++)
 	{
-		lcd.write(0xFF);
+		display.Write(0xFF);
+		display.Render();
 		_delay_ms(100);
 	}
 	
-	lcd.clear();
+	display.Clear();
 }
 
 /************************************************************************/
@@ -718,25 +867,192 @@ void LoadingBar(void)
 /************************************************************************/
 void ClearLine(int line)
 {
-	lcd.setCursor(0, line);
+	display.SetCursor(0, line);
 	
 	for(int i = 0; i < LINE_LEN; i++)
 	{
-		lcd.print(" ");
+		display.Write(' ');
 	}
 	
-	lcd.setCursor(0, line);
+	display.SetCursor(0, line);
+}
+
+/************************************************************************/
+/* Draw a frame of the sort screen from a snapshot of the sorter		*/
+/************************************************************************/
+void PrintSortFrame(void)
+{
+	T_SorterSnapshot snapshot;
+	
+	sorter.GetSnapshot(snapshot);
+	
+	//Dot animation, one step a second
+	display.SetCursor(7, LINE_1);
+	display.Print_P(TextDots[(snapshot.RunTime / 1000) & 3]);
+	
+	display.SetCursor(0, LINE_3);
+	display.Print_P(TextWhite);
+	display.PrintNumber<5>(snapshot.WhiteCount);
+	display.Print_P(TextBlack);
+	display.PrintNumber<5>(snapshot.BlackCount);
+	
+	display.SetCursor(0, LINE_4);
+	display.Print_P(TextClockIndent);
+	display.PrintNumber<2>(snapshot.RunTime / 60000);
+	display.Write(':');
+	display.PrintNumber<2>((snapshot.RunTime / 1000) % 60);
+	display.Write(':');
+	display.PrintNumber<1>((snapshot.RunTime / 100) % 10);
+	display.Print_P(TextClockEnd);
 }
 
 void PrintIdleScreen(void)
 {
-	lcd.clear();
-	lcd.home();
-	lcd.print("PRESS S -> Sort");
+	display.PrintScreen_P(IdleScreen);
+}
+
+/************************************************************************/
+/* Print a Recall Page: the last checkpoint, then each run from the		*/
+/* newest, then the totals. Returns false, leaving the screen as it is,	*/
+/* if the run can't be read until the EEPROM writer is done				*/
+/************************************************************************/
+bool PrintRecallPage(int page)
+{
+	const T_RunTotals &totals = sorter.History.GetTotals();
+	
+	if((page > 0) && (page <= totals.Runs) && !sorter.History.IsReadable(page - 1))
+	{
+		return false;
+	}
+	
+	display.Clear();
+	
+	//Last checkpoint
+	if(page == 0)
+	{
+		T_CountRecord record;
+		
+		//Zeros if there has not been a checkpoint
+		if(!sorter.Log.GetNewest(record))
+		{
+			memset(&record, 0, sizeof(record));
+		}
+		
+		//Labels from the layout, values after them
+		display.PrintScreen_P(RecallScreen);
+		
+		display.SetCursor(6, LINE_2);
+		display.PrintNumber<2>(record.RunTime / 60000);
+		display.Write(':');
+		display.PrintNumber<2>((record.RunTime / 1000) % 60);
+		display.Write(':');
+		display.PrintNumber<3>(record.RunTime % 1000);
+		
+		display.SetCursor(13, LINE_3);
+		display.PrintNumber<3>(record.WhiteCount);
+		
+		display.SetCursor(13, LINE_4);
+		display.PrintNumber<3>(record.BlackCount);
+	}
+	
+	//One run
+	else if(page <= totals.Runs)
+	{
+		T_RunSummary summary;
+		
+		if(!sorter.History.GetRun(page - 1, summary))
+		{
+			display.Print_P(TextRunNotReadable);
+			return true;
+		}
+		
+		display.Print_P(TextRun);
+		display.PrintNumber<5, ' ', AlignLeft>(summary.Sequence);
+		display.Print_P(TextFault);
+		display.PrintSigned<4>(summary.Fault);
+		
+		display.SetCursor(0, LINE_2);
+		display.Print_P(TextTime);
+		display.PrintNumber<5>(summary.StartTime / 1000);
+		display.Write('-');
+		display.PrintNumber<5>(summary.StopTime / 1000);
+		display.Write('s');
+		
+		display.SetCursor(0, LINE_3);
+		display.Print_P(TextWhite);
+		display.PrintNumber<5>(summary.WhiteCount);
+		display.Print_P(TextBlack);
+		display.PrintNumber<5>(summary.BlackCount);
+		
+		display.SetCursor(0, LINE_4);
+		display.Print_P(TextRate);
+		display.PrintNumber<1>(summary.Throughput);
+		display.Print_P(TextPerMinute);
+	}
+	
+	//Totals over the runs
+	else
+	{
+		display.Print_P(TextLast);
+		display.PrintNumber<1>(totals.Runs);
+		display.Print_P(TextRuns);
+		
+		display.SetCursor(0, LINE_2);
+		display.Print_P(TextTime);
+		display.PrintNumber<1>(totals.RunTime / 1000);
+		display.Write('s');
+		
+		display.SetCursor(0, LINE_3);
+		display.Print_P(TextWhite);
+		display.PrintNumber<5>(totals.WhiteCount);
+		display.Print_P(TextBlack);
+		display.PrintNumber<5>(totals.BlackCount);
+		
+		display.SetCursor(0, LINE_4);
+		display.Print_P(TextMean);
+		display.PrintNumber<1>(RunHistory::MarblesPerMinute(totals.BlackCount + totals.WhiteCount, totals.RunTime));
+		display.Print_P(TextPerMinute);
+	}
+	
+	return true;
+}
+
+/************************************************************************/
+/* Print the sampler and scheduler statistics							*/
+/************************************************************************/
+void PrintTelemetry(void)
+{
+#if SERVO_DRIVER == SERVO_DRIVER_MUX
+	//Worst servo edge lateness in us, kept to the end of the line and
+	// flagged if it is past the bound worked out in ServoMux.h
+	uint16_t lateness = servoMux.GetMaxLateness();
+	
+	display.SetCursor(12, LINE_1);
+	display.Print_P((lateness > SERVO_MUX_LATENESS_US) ? TextLatenessOver : TextLateness);
+	display.PrintNumber<3>((lateness > 999) ? 999 : lateness);
+#endif
 	
-	lcd.setCursor(0, LINE_2);
-	lcd.print("PRESS R -> Reset");
+	display.SetCursor(0, LINE_2);
+	display.Print_P(TextRate);
 	
-	lcd.setCursor(0, LINE_3);
-	lcd.print("HOLD  S -> Recall");
-}
\ No newline at end of file
+	for(int lane = 0; lane < SORTER_LANES; lane++)
+	{
+		display.PrintNumber<5>(sorter.Sampler.GetSampleRate(lane));
+		display.Write(' ');
+	}
+	
+	display.SetCursor(0, LINE_3);
+	display.Print_P(TextLost);
+	
+	for(int lane = 0; lane < SORTER_LANES; lane++)
+	{
+		display.PrintNumber<3>(sorter.Sampler.GetOverruns(lane));
+		display.Write(' ');
+	}
+	
+	display.SetCursor(0, LINE_4);
+	display.Print_P(TextMisses);
+	display.PrintNumber<4>(scheduler.GetMisses());
+	display.Print_P(TextLongest);
+	display.PrintNumber<3>(scheduler.GetLongestPass());
+}
@@ -8,5 +8,7 @@ LCD_I2C.c
 
 twimaster.c
 
+twiqueue.c
+
 usart.c
 
@@ -15,6 +15,12 @@
 #include "i2clcd.h"
 #include "usart.h"
 
+//1ms tick, watches the I2C bus for a timeout
+ISR(TIMER0_COMPA_vect)
+{
+	twi_tick();
+}
+
 int main(void)
 {	
 	//PB5 as LED
@@ -23,9 +29,21 @@ int main(void)
 	//Configure USART
 	USART_Init(MYUBRR);
 	
-	USART_Send_string("Before i2c_init()\n");
-	i2c_init();
-	USART_Send_string("After i2c_init()\n");
+	USART_Send_string("Before twi_init()\n");
+	twi_init();
+	if(i2c_probe_speed(LCD_I2C_DEVICE) == I2C_FAST)
+	{
+		USART_Send_string("I2C at 400kHz\n");
+	}
+	
+	//Timer0 CTC at 1ms (16MHz / 64 / 250)
+	TCCR0A = _BV(WGM01);
+	TCCR0B = _BV(CS01) | _BV(CS00);
+	OCR0A = 249;
+	TIMSK0 = _BV(OCIE0A);
+	
+	sei();							//TWI_vect sends the LCD writes
+	USART_Send_string("After twi_init()\n");
 	
 	USART_Send_string("Before lcd_init()\n");
 	lcd_init();						//Display initialization
@@ -40,6 +58,9 @@ int main(void)
 		USART_Send_string("\nIN LOOP\n");
 		PORTB ^= _BV(5);
 		_delay_ms(1000);
-		lcd_print("HELLO WORLD!");		//Print a string	
+		if(lcd_ready())					//Clear and init waits are done in the background
+		{
+			lcd_print("HELLO WORLD!");	//Print a string
+		}
 	}
 }
\ No newline at end of file
@@ -39,14 +39,17 @@
 
 
 int backlight = OFF;
+unsigned char lcd_stream_mode;                  //-     RS and RW last set up in the open transaction
+
 //-     Display initialization sequence
 void lcd_init(void)
 {       
-        lcd_wait_ms(16);                //-     Wait for more than 15ms after VDD rises to 4.5V
+        //-     The waits are queued between the writes, nothing here blocks
+        twi_pause(LCD_TICKS(LCD_POWERON_US));   //-     Wait for more than 15ms after VDD rises to 4.5V
         lcd_write(LCD_D5 | LCD_D4);     //-     Set interface to 8-bit
-        lcd_wait_ms(5);                 //-     Wait for more than 4.1ms
+        twi_pause(LCD_TICKS(LCD_RESET_US));     //-     Wait for more than 4.1ms
         lcd_write(LCD_D5 | LCD_D4);     //-     Set interface to 8-bit
-        lcd_wait_us(101);               //-     Wait for more than 100us    
+        twi_pause(LCD_TICKS(LCD_RESET2_US));    //-     Wait for more than 100us
         lcd_write(LCD_D5 | LCD_D4);     //-     Set interface to 8-bit
         lcd_write(LCD_D5);              //-     Set interface to 4-bit
         //- From now on in 4-bit-Mode
@@ -57,114 +60,217 @@ void lcd_init(void)
 		lcd_command(LCD_DISPLAYON);                             //-     Display on
 }
 
-//-     Write data to i2c
-void lcd_write_i2c(unsigned char value)
+//-     Set or clear the backlight bit of an expander byte
+static unsigned char lcd_with_backlight(unsigned char value)
 {
-        i2c_start_wait(LCD_I2C_DEVICE+I2C_WRITE);
-		
 	if (backlight) {
 		value |= (1 << LCD_BL_PIN);
 	} else {
 		value &= ~(1 << LCD_BL_PIN);
-	}	
-		
-        i2c_write(value);
-        i2c_stop();
+	}
+
+	return value;
+}
+
+//-     Write data to i2c (queued, sent in the background)
+void lcd_write_i2c(unsigned char value)
+{
+        value = lcd_with_backlight(value);
+        twi_write(LCD_I2C_DEVICE+I2C_WRITE, &value, 1);
 }
 
-//-     Write byte to display with toggle of enable-bit
+//-     Open one i2c transaction for a run of display writes
+bool lcd_stream_begin(void)
+{
+        if(twi_begin(LCD_I2C_DEVICE+I2C_WRITE) != TWI_OK) return false;
+
+        lcd_stream_mode = 0xFF;                 //-     RS and RW not set up yet
+        return true;
+}
+
+//-     Add one nibble with toggle of enable-bit to the open transaction
+void lcd_stream_nibble(unsigned char value)
+{
+        value = lcd_with_backlight(value);
+
+        //-     RS and RW must settle before enable rises, data only before it falls
+        if((value & (LCD_RS | LCD_RW)) != lcd_stream_mode)
+        {
+                twi_put(value & ~LCD_E);
+                lcd_stream_mode = value & (LCD_RS | LCD_RW);
+        }
+
+        twi_put(value | LCD_E);                 //-     Set enable to high with the data
+        twi_put(value & ~LCD_E);                //-     Set enable to low, display latches the data
+}
+
+//-     Add one byte as two nibbles to the open transaction (mode is 0 for a command or LCD_RS for data)
+void lcd_stream_byte(unsigned char value, unsigned char mode)
+{
+        lcd_stream_nibble((value & 0xF0) | mode);
+        lcd_stream_nibble((value << 4) | mode);
+}
+
+//-     Queue the open transaction (false if it did not fit)
+bool lcd_stream_end(void)
+{
+        return (twi_end() == TWI_OK);
+}
+
+//-     Write nibble to display with toggle of enable-bit
 void lcd_write(unsigned char value)
 {
-        lcd_write_i2c(value | LCD_E);           //-     Set enable to high
-        lcd_write_i2c(value | LCD_E);           //-     Send data, keep enable high
-        lcd_write_i2c(value & (!LCD_E));        //-     Set enable to low
+        if(!lcd_stream_begin()) return;
+        lcd_stream_nibble(value);
+        lcd_stream_end();
 }
 
-//-     Print string to cursor position
-void lcd_print(unsigned char *string)
+//-     Stream a string, LCD_STREAM_CHARS characters per i2c transaction
+static void lcd_stream_string(unsigned char *string)
 {
-        unsigned char i = 0;
-        while(string[i] != 0x00)
+        unsigned char count;
+
+        while(*string != 0x00)
         {
-                lcd_putchar(string[i]);
-                i++;
+                if(!lcd_stream_begin()) return;
+
+                for(count = 0; (count < LCD_STREAM_CHARS) && (*string != 0x00); count++)
+                {
+                        lcd_stream_byte(*string++, LCD_RS);
+                }
+
+                if(!lcd_stream_end()) return;
         }
 }
 
+//-     DDRAM address of a position, 0xFF if off the display
+static unsigned char lcd_address(unsigned char line, unsigned char row)
+{
+        unsigned char address;
+
+        if(line > LCD_LINES) return 0xFF;
+        if(row > LCD_ROWS) return 0xFF;
+        if((line == 0) || (row == 0) ) return 0xFF;
+
+        address = LCD_LINE1;
+#if LCD_LINES>=2
+        if (line == 2) address = LCD_LINE2;
+#endif
+#if LCD_LINES>=3
+        if (line == 3) address = LCD_LINE3;
+#endif
+#if LCD_LINES>=4
+        if (line == 4) address = LCD_LINE4;
+#endif
+        return address + (row - 1);
+}
+
+//-     Print string to cursor position
+void lcd_print(unsigned char *string)
+{
+        lcd_stream_string(string);
+}
+
 //-     Put char to cursor position
 void lcd_putchar(unsigned char value)
 {
-        unsigned char lcddata;
-        lcddata = value;
-        lcddata >>= 4;
-        lcddata |= LCD_RS;
-        lcd_write(lcddata);
-        lcddata = value;
-        lcddata &= 0x0F;
-        lcddata |= LCD_RS;
-        lcd_write(lcddata);
+        if(!lcd_stream_begin()) return;
+        lcd_stream_byte(value, LCD_RS);
+        lcd_stream_end();
 }
 
 //-     Put char to position
 bool lcd_putcharlr(unsigned char line, unsigned char row, unsigned char value)
 {
-        if(!lcd_gotolr(line, row)) return false;
-        lcd_putchar(value);
-        
-        return true;
+        unsigned char address = lcd_address(line, row);
+
+        if(address == 0xFF) return false;
+
+        //-     Cursor move and character in one transaction
+        if(!lcd_stream_begin()) return false;
+        lcd_stream_byte(LCD_SETDDRAM | address, 0);
+        lcd_stream_byte(value, LCD_RS);
+        return lcd_stream_end();
+}
+
+//-     Execution time of a command that outlasts the i2c bytes sent after it, 0 for the rest
+static unsigned short lcd_command_us(unsigned char command)
+{
+        if(command == LCD_CLEAR) return LCD_CLEAR_US;
+        if((command & ~0x01) == LCD_HOME) return LCD_HOME_US;
+        return 0;
 }
 
 //-     Issue a command to the display (use the defined commands above)
 void lcd_command(unsigned char command)
 {
-        unsigned char lcddata;
-        lcddata = command;
-        lcddata >>=  4;
-        lcd_write(lcddata);
-        lcddata = command;
-        lcddata &= 0x0F;
-        lcd_write(lcddata);     
+        unsigned short us = lcd_command_us(command);
+
+        if(!lcd_stream_begin()) return;
+        lcd_stream_byte(command, 0);
+        if(!lcd_stream_end()) return;
+
+        //-     Hold back whatever is queued next until the display is done
+        if(us) twi_pause(LCD_TICKS(us));
 }
 
-//-     Print string to position (If string is longer than LCD_ROWS overwrite first chars)(line, row, string)
-bool lcd_printlc(unsigned char line, unsigned char row, unsigned char *string)
+//-     Check if every queued write and wait is done (never blocks)
+bool lcd_ready(void)
 {
-        unsigned char i;
-                
-        for(i = 0; string[i] != 0x00; i++)
-        {
-                if (!lcd_putcharlr(line, row, string[i])) return false;
-                row++;
-                if(row > LCD_ROWS)
-                {
-                        row = 1;
-                }
-        }
-        return true;
+        return !twi_busy();
 }
 
-//-     Print string to position (If string is longer than LCD_ROWS continue in next line)(line, row, string)
-bool lcd_printlrc(unsigned char line, unsigned char row, unsigned char *string)
+//-     Stream a string from a position, wrapping at LCD_ROWS to the first row of the same or the next line
+static bool lcd_stream_wrapped(unsigned char line, unsigned char row, unsigned char *string, bool nextline)
 {
-        unsigned char i;
-                
-        for(i = 0; string[i] != 0x00; i++)
+        unsigned char count = LCD_STREAM_CHARS;
+
+        if(lcd_address(line, row) == 0xFF) return false;
+
+        while(*string != 0x00)
         {
-                if(!lcd_putcharlr(line, row, string[i])) return false;
+                //-     Each transaction starts with the cursor position, so a dropped one cannot shift the next
+                if(count == LCD_STREAM_CHARS)
+                {
+                        if(!lcd_stream_begin()) return false;
+                        lcd_stream_byte(LCD_SETDDRAM | lcd_address(line, row), 0);
+                        count = 0;
+                }
+
+                lcd_stream_byte(*string++, LCD_RS);
+                count++;
+
                 row++;
                 if(row > LCD_ROWS)
                 {
-                        line++;
                         row = 1;
+                        if(nextline) line++;
+                        if(line > LCD_LINES) line = 1;
+
+                        //-     Lines are not contiguous in DDRAM
+                        lcd_stream_byte(LCD_SETDDRAM | lcd_address(line, row), 0);
                 }
-                if(line > LCD_LINES)
+
+                if((count == LCD_STREAM_CHARS) || (*string == 0x00))
                 {
-                        line = 1;
+                        if(!lcd_stream_end()) return false;
                 }
         }
         return true;
 }
 
+//-     Print string to position (If string is longer than LCD_ROWS overwrite first chars)(line, row, string)
+bool lcd_printlc(unsigned char line, unsigned char row, unsigned char *string)
+{
+        return lcd_stream_wrapped(line, row, string, false);
+}
+
+//-     Print string to position (If string is longer than LCD_ROWS continue in next line)(line, row, string)
+bool lcd_printlrc(unsigned char line, unsigned char row, unsigned char *string)
+{
+        return lcd_stream_wrapped(line, row, string, true);
+}
+
 //-     Print string to position (line, row, string)
 bool lcd_printlr(unsigned char line, unsigned char row, unsigned char *string)
 {
@@ -177,27 +283,13 @@ bool lcd_printlr(unsigned char line, unsigned char row, unsigned char *string)
 //-     Go to position (line, row)
 bool lcd_gotolr(unsigned char line, unsigned char row )
 {
-        unsigned char lcddata;
-        
-        if(line > LCD_LINES) return false;
-        if(row > LCD_ROWS) return false;
-        if((line == 0) || (row == 0) ) return false;
-                
-        lcddata = LCD_D7;
-#if LCD_LINES>=2
-        if (line == 2) lcddata = LCD_D7 |  (LCD_LINE2 >> 4);
-#endif
-#if LCD_LINES>=3
-        if (line == 3) lcddata = LCD_D7 |  (LCD_LINE3 >> 4);
-#endif
-#if LCD_LINES>=4
-        if (line == 4) lcddata = LCD_D7 |  (LCD_LINE4 >> 4);
-#endif
-        lcd_write(LCD_E | lcddata);
-        lcddata = (row-1);
-        lcd_write(LCD_E | lcddata);
-        
-        return true;    
+        unsigned char address = lcd_address(line, row);
+
+        if(address == 0xFF) return false;
+
+        lcd_command(LCD_SETDDRAM | address);
+
+        return true;
 }
 
 //-     Go to nextline (if next line > LCD_LINES return false)
@@ -213,7 +305,8 @@ bool lcd_nextline(void)
 unsigned char lcd_read_i2c(void)
 {
         unsigned char lcddata = 0x00;
-        i2c_start_wait(LCD_I2C_DEVICE+I2C_READ);
+        while(twi_busy());                      //-     The blocking read shares the TWI with the queue
+        if(i2c_start_wait(LCD_I2C_DEVICE+I2C_READ)) return lcddata;
         lcddata = i2c_readNak();
         i2c_stop();
         return lcddata;
@@ -239,42 +332,47 @@ unsigned char lcd_getbyte(bool mode)
         unsigned char hib, lob;
         hib = lcd_read(mode);
         lob = lcd_read(mode);
-        return (hib << 4) + (lob & 0x0F);
+        return (hib & 0xF0) | (lob >> 4);       //-     Data comes in on P4-P7
 }
 
 //-     Get line and row (target byte for line, target byte for row)
 bool lcd_getlr(unsigned char *line, unsigned char *row)
 {
-        unsigned char lcddata, tmp;
+        unsigned char lcddata, start;
         lcddata =       lcd_getbyte(LCD_ADDRESS);
         if (lcddata & (1 << 7)) return false;
-        tmp = lcddata;
-        tmp &= 0xF0;
-        switch(tmp)
+        //-     Lines 3 and 4 continue lines 1 and 2 in DDRAM, so look the address up by range
+        if (lcddata < LCD_LINE1 + LCD_ROWS)                     //-     LCD_LINE1 is always 0x00
         {
-                case LCD_LINE1:
-                        *line = 1;
-                        break;
+                *line = 1;
+                start = LCD_LINE1;
+        }
 #if LCD_LINES>=2
-                case LCD_LINE2:
-                        *line = 2;
-                        break;
+        else if ((lcddata >= LCD_LINE2) && (lcddata < LCD_LINE2 + LCD_ROWS))
+        {
+                *line = 2;
+                start = LCD_LINE2;
+        }
 #endif
 #if LCD_LINES>=3
-                case LCD_LINE3:
-                        *line = 3;
-                        break;
+        else if ((lcddata >= LCD_LINE3) && (lcddata < LCD_LINE3 + LCD_ROWS))
+        {
+                *line = 3;
+                start = LCD_LINE3;
+        }
 #endif
 #if LCD_LINES>=4
-                case LCD_LINE4:
-                        *line = 4;
-                        break;
+        else if ((lcddata >= LCD_LINE4) && (lcddata < LCD_LINE4 + LCD_ROWS))
+        {
+                *line = 4;
+                start = LCD_LINE4;
+        }
 #endif
-                default:
-                        return false;
+        else
+        {
+                return false;
         }
-        lcddata &= 0x0F;
-        *row = lcddata + 1;
+        *row = lcddata - start + 1;
         return true;
 }
 
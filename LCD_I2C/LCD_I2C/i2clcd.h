@@ -109,6 +109,7 @@
 #include <stdbool.h>
 #include <stdint.h> 
 #include "i2cmaster.h"
+#include "twiqueue.h"
 
 //--Display-Configuration-Settings-----------------------------------------------------------------------------------
 
@@ -116,14 +117,48 @@
  Change this settings to your configuration.
 */
 /*@{*/
-#define LCD_I2C_DEVICE		0x27	/**< Change this to the address of your expander */
+#define LCD_I2C_DEVICE		(0x27 << 1)	/**< Change this to the address of your expander (shifted left for the R/W bit) */
 #define LCD_LINES			4		/**< Enter the number of lines of your display here */
 #define LCD_ROWS			20		/**< Enter the number of rows of your display here */
 
 #define LCD_LINE1			0x00	/**< This should be 0x00 on all displays */
 #define LCD_LINE2			0x40	/**< Change this to the address for line 2 on your display */
-#define LCD_LINE3			0x10	/**< Change this to the address for line 3 on your display */
-#define LCD_LINE4			0x50	/**< Change this to the address for line 4 on your display */
+#define LCD_LINE3			0x14	/**< Change this to the address for line 3 on your display */
+#define LCD_LINE4			0x54	/**< Change this to the address for line 4 on your display */
+
+#define LCD_STREAM_CHARS	16		/**< Characters sent per i2c transaction (at most 4 bytes each, must fit TWI_BUFFER_LEN) */
+/*@}*/
+
+//-------------------------------------------------------------------------------------------------------------------
+
+//--Command-Timing---------------------------------------------------------------------------------------------------
+
+/** \defgroup COMMAND_TIMING COMMAND TIMING
+ Execution times of the controller, HD44780 datasheet values at 270kHz. Calibrate them to your display. \n
+ Every other command and data write takes 37us, less than the two i2c bytes between enable pulses
+ even at 400kHz, so only these are waited for. Waits are queued with twi_pause() in twi_tick() periods.
+*/
+/*@{*/
+#ifndef LCD_POWERON_US
+#define LCD_POWERON_US		15000	/**< Power on to first command */
+#endif
+#ifndef LCD_RESET_US
+#define LCD_RESET_US		4100	/**< After the first function set */
+#endif
+#ifndef LCD_RESET2_US
+#define LCD_RESET2_US		100		/**< After the second function set */
+#endif
+#ifndef LCD_CLEAR_US
+#define LCD_CLEAR_US		1520	/**< Clear display */
+#endif
+#ifndef LCD_HOME_US
+#define LCD_HOME_US			1520	/**< Return home */
+#endif
+
+#define LCD_TICK_US			1000	/**< twi_tick() period */
+
+/** Pause covering a time: a count of n ticks lasts more than n - 1 tick periods */
+#define LCD_TICKS(us)		((us) / LCD_TICK_US + 2)
 /*@}*/
 
 //-------------------------------------------------------------------------------------------------------------------
@@ -148,10 +183,10 @@
 //-------------------------------------------------------------------------------------------------------------------
 
 /** \defgroup DEFINED_BITS DEFINED BITS
- With each read/write operation to/from the display two bytes are send/received. \n
- In each of those two bytes the higher nibble contains the RS, RW, EMPTY and ENABLE bit.
- In the byte which is read/written first, the lower nibble contains bits 0 to 3 and \n 
- in the second byte the lower nibble contains bit 4 to 7. 
+ With each read/write operation to/from the display two nibbles are send/received. \n
+ In each expander byte the lower nibble contains the RS, RW, BACKLIGHT and ENABLE bit.
+ In the byte which is read/written first, the higher nibble contains bits 4 to 7 and \n
+ in the second byte the higher nibble contains bit 0 to 3.
 */
 /*@{*/
 #define LCD_D0				(1 << LCD_D4_PIN)	/**< bit 0 in 1st lower nibble */
@@ -195,6 +230,7 @@
 /*@{*/ 
 #define LCD_CLEAR			0x01	/**< Clear screen */
 #define LCD_HOME			0x02	/**< Cursor move to first digit */
+#define LCD_SETDDRAM			0x80	/**< Set cursor address (OR with the DDRAM address) */
 /*@}*/ 
 
 /** @name ENTRYMODES */
@@ -262,11 +298,43 @@ void lcd_init(void);					//-	Display initialization sequence
 void lcd_write_i2c(unsigned char value);		//-	Write data to i2c
 
 /**
- \brief Write byte to display with toggle of enable-bit
- \param value the upper nibble represents  E, RS, RW pins and the lower nibble contains data D0 to D3 pins or D4 to D7 pins
+ \brief Write nibble to display with toggle of enable-bit
+ \param value the lower nibble represents  E, RS, RW pins and the upper nibble contains data D0 to D3 pins or D4 to D7 pins
  \return none
  */
-void lcd_write(unsigned char value);			//-	Write byte to display with toggle of enable-bit
+void lcd_write(unsigned char value);			//-	Write nibble to display with toggle of enable-bit
+
+/**
+ \brief Open one i2c transaction for a run of display writes (for internal use)
+ 
+ Nibbles added with lcd_stream_nibble() or lcd_stream_byte() are sent between one START and STOP.
+ Commands that need more than 40us to execute (LCD_CLEAR, LCD_HOME) must end a transaction.
+ \retval true if successfull
+ \retval false if the i2c queue is full
+ */
+bool lcd_stream_begin(void);				//-	Open one i2c transaction
+
+/**
+ \brief Add one nibble with toggle of enable-bit to the open transaction (for internal use)
+ \param value same as lcd_write()
+ \return none
+ */
+void lcd_stream_nibble(unsigned char value);		//-	Add one nibble to the open transaction
+
+/**
+ \brief Add one byte as two nibbles to the open transaction (for internal use)
+ \param value command or character
+ \param mode 0 for a command or LCD_RS for data
+ \return none
+ */
+void lcd_stream_byte(unsigned char value, unsigned char mode);	//-	Add one byte to the open transaction
+
+/**
+ \brief Queue the open transaction (for internal use)
+ \retval true if successfull
+ \retval false if it did not fit the i2c queue and was dropped
+ */
+bool lcd_stream_end(void);				//-	Queue the open transaction
 
 /**
  \brief Go to position
@@ -380,7 +448,14 @@ unsigned char lcd_getbyte(bool mode);			//-	Read one complete byte over i2c from
 bool lcd_getlr(unsigned char *line, unsigned char*row);	//-	Get line and row (target byte for line, target byte for row)
 
 /**
- \brief Check if busy
+ \brief Check if every queued write and wait is done, without blocking
+ \retval true if the display has taken everything queued
+ \retval false if writes or waits are still queued
+ */
+bool lcd_ready(void);					//-	Check if every queued write and wait is done
+
+/**
+ \brief Check if busy (reads the busy flag, waits for the i2c queue first)
  \retval true if busy
  \retval false if not busy
  */
@@ -93,6 +93,12 @@
 /** defines the data direction (writing to I2C device) in i2c_start(),i2c_rep_start() */
 #define I2C_WRITE   0
 
+/** Standard mode bus clock (100 kHz) for i2c_set_speed() */
+#define I2C_STANDARD 0
+
+/** Fast mode bus clock (400 kHz) for i2c_set_speed() */
+#define I2C_FAST     1
+
 
 /**
  @brief initialize the I2C master interace. Need to be called only once 
@@ -102,6 +108,42 @@
 extern void i2c_init(void);
 
 
+/**
+ @brief select the bus clock, only while no transfer is in progress
+ @param  speed I2C_STANDARD (100 kHz) or I2C_FAST (400 kHz)
+ @return none
+ */
+extern void i2c_set_speed(unsigned char speed);
+
+
+/**
+ @brief get the selected bus clock
+ @return I2C_STANDARD or I2C_FAST
+ */
+extern unsigned char i2c_get_speed(void);
+
+
+/**
+ @brief select Fast mode if a device answers reliably at 400 kHz, else Standard mode
+
+ Call once at startup, before other transfers.
+ @param  addr address of I2C device (without transfer direction)
+ @return I2C_FAST or I2C_STANDARD, the speed selected
+ */
+extern unsigned char i2c_probe_speed(unsigned char addr);
+
+
+/**
+ @brief free a stuck bus and re-initialize the TWI
+
+ Clocks SCL until a slave holding SDA low lets go (at most 9 clocks), sends
+ a STOP and re-initializes the TWI. Called on every bus timeout.
+ @retval   0 bus free
+ @retval   1 SDA still held low
+ */
+extern unsigned char i2c_recover(void);
+
+
 /** 
  @brief Terminates the data transfer and releases the I2C bus 
  @param void
@@ -135,9 +177,10 @@ extern unsigned char i2c_rep_start(unsigned char addr);
    
  If device is busy, use ack polling to wait until device ready 
  @param    addr address and transfer direction of I2C device
- @return   none
+ @retval   0 device accessible
+ @retval   1 device did not answer, gave up
  */
-extern void i2c_start_wait(unsigned char addr);
+extern unsigned char i2c_start_wait(unsigned char addr);
 
  
 /**
@@ -11,7 +11,6 @@
 #include <util/delay.h>
 
 #include "i2cmaster.h"
-#include "usart.h"
 
 
 /* define CPU frequency in Mhz here if not defined in Makefile */
@@ -19,8 +18,54 @@
 #define F_CPU 16000000UL
 #endif
 
-/* I2C clock in Hz */
-#define SCL_CLOCK  100000L
+/* I2C clocks in Hz */
+#define SCL_CLOCK_STANDARD  100000L
+#define SCL_CLOCK_FAST      400000L
+
+/* TWBR for a clock, TWPS = 0 => prescaler = 1 */
+#define SCL_TWBR(clock)  (((F_CPU/(clock))-16)/2)
+
+/* TWI pins, driven by hand during bus recovery (ATmega328P: SDA PC4, SCL PC5) */
+#ifndef I2C_PORT
+#define I2C_PORT  PORTC
+#define I2C_DDR   DDRC
+#define I2C_PIN   PINC
+#define I2C_SDA   4
+#define I2C_SCL   5
+#endif
+
+/* longest wait on the bus before it is taken as stuck and recovered */
+#define I2C_TIMEOUT_US      1000
+
+/* START attempts made by i2c_start_wait before it gives up */
+#define I2C_START_RETRIES   100
+
+/* error free transfers required before Fast mode is kept */
+#define I2C_PROBE_TRIES     16
+
+
+static uint8_t i2c_speed = I2C_STANDARD;
+
+
+/*************************************************************************
+ Wait for the TWI to finish the current step
+
+ Return:  0 done, 1 timed out (bus recovered)
+*************************************************************************/
+static unsigned char i2c_wait(void)
+{
+    uint16_t us;
+
+    for (us = 0; us < I2C_TIMEOUT_US; us++)
+    {
+        if (TWCR & (1<<TWINT)) return 0;
+        _delay_us(1);
+    }
+
+    i2c_recover();
+    return 1;
+
+}/* i2c_wait */
 
 
 /*************************************************************************
@@ -28,14 +73,116 @@
 *************************************************************************/
 void i2c_init(void)
 {
-  /* initialize TWI clock: 100 kHz clock, TWPS = 0 => prescaler = 1 */
+  /* initialize TWI clock at the selected speed, TWPS = 0 => prescaler = 1 */
   
   TWSR = 0;                         /* no prescaler */
-  TWBR = ((F_CPU/SCL_CLOCK)-16)/2;  /* must be > 10 for stable operation */
+  i2c_set_speed(i2c_speed);
 
 }/* i2c_init */
 
 
+/*************************************************************************
+ Select the bus clock: I2C_STANDARD (100 kHz) or I2C_FAST (400 kHz)
+*************************************************************************/
+void i2c_set_speed(unsigned char speed)
+{
+  i2c_speed = speed;
+
+  /* TWBR must be > 10 for stable operation */
+  TWBR = (speed == I2C_FAST) ? SCL_TWBR(SCL_CLOCK_FAST) : SCL_TWBR(SCL_CLOCK_STANDARD);
+
+}/* i2c_set_speed */
+
+
+/*************************************************************************
+ Get the selected bus clock
+*************************************************************************/
+unsigned char i2c_get_speed(void)
+{
+  return i2c_speed;
+
+}/* i2c_get_speed */
+
+
+/*************************************************************************
+ Free a stuck bus and re-initialize the TWI
+
+ A slave that lost a clock edge can hold SDA low forever waiting for the
+ rest of its byte. Clocking SCL by hand until it lets go (at most 9 clocks)
+ and then sending a STOP puts every slave back to idle.
+
+ Return:  0 bus free, 1 SDA still held low
+*************************************************************************/
+unsigned char i2c_recover(void)
+{
+    uint8_t i;
+
+    /* take the pins from the TWI; outputs only ever drive low */
+    TWCR = 0;
+    I2C_PORT &= ~((1<<I2C_SDA) | (1<<I2C_SCL));
+    I2C_DDR &= ~((1<<I2C_SDA) | (1<<I2C_SCL));
+    _delay_us(5);
+
+    for (i = 0; (i < 9) && !(I2C_PIN & (1<<I2C_SDA)); i++)
+    {
+        I2C_DDR |= (1<<I2C_SCL);
+        _delay_us(5);
+        I2C_DDR &= ~(1<<I2C_SCL);
+        _delay_us(5);
+    }
+
+    /* STOP: SDA rises while SCL is high */
+    I2C_DDR |= (1<<I2C_SCL);
+    _delay_us(5);
+    I2C_DDR |= (1<<I2C_SDA);
+    _delay_us(5);
+    I2C_DDR &= ~(1<<I2C_SCL);
+    _delay_us(5);
+    I2C_DDR &= ~(1<<I2C_SDA);
+    _delay_us(5);
+
+    i2c_init();
+    TWCR = (1<<TWEN);
+
+    return (I2C_PIN & (1<<I2C_SDA)) ? 0 : 1;
+
+}/* i2c_recover */
+
+
+/*************************************************************************
+ Select the fastest speed a device answers reliably at
+
+ Reads the device I2C_PROBE_TRIES times at 400 kHz and keeps Fast mode
+ only if every read was acknowledged, else falls back to 100 kHz.
+ Reading has no side effects on an I/O expander.
+
+ Input:   address of I2C device (without transfer direction)
+ Return:  I2C_FAST or I2C_STANDARD, the speed selected
+*************************************************************************/
+unsigned char i2c_probe_speed(unsigned char address)
+{
+    uint8_t i;
+
+    i2c_set_speed(I2C_FAST);
+
+    for (i = 0; i < I2C_PROBE_TRIES; i++)
+    {
+        if (i2c_start(address+I2C_READ))
+        {
+            i2c_stop();
+            i2c_set_speed(I2C_STANDARD);
+            break;
+        }
+
+        i2c_readNak();
+        i2c_stop();
+    }
+
+    return i2c_speed;
+
+}/* i2c_probe_speed */
+
+
 /*************************************************************************	
   Issues a start condition and sends address and transfer direction.
   return 0 = device accessible, 1= failed to access device
@@ -48,7 +195,7 @@ unsigned char i2c_start(unsigned char address)
 	TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
 
 	// wait until transmission completed
-	while(!(TWCR & (1<<TWINT)));
+	if (i2c_wait()) return 1;
 
 	// check value of TWI Status Register. Mask prescaler bits.
 	twst = TW_STATUS & 0xF8;
@@ -59,7 +206,7 @@ unsigned char i2c_start(unsigned char address)
 	TWCR = (1<<TWINT) | (1<<TWEN);
 
 	// wail until transmission completed and ACK/NACK has been received
-	while(!(TWCR & (1<<TWINT)));
+	if (i2c_wait()) return 1;
 
 	// check value of TWI Status Register. Mask prescaler bits.
 	twst = TW_STATUS & 0xF8;
@@ -75,62 +222,48 @@ unsigned char i2c_start(unsigned char address)
  If device is busy, use ack polling to wait until device is ready
  
  Input:   address and transfer direction of I2C device
+
+ Return:  0 device accessible
+          1 device did not answer within I2C_START_RETRIES attempts
 *************************************************************************/
-void i2c_start_wait(unsigned char address)
+unsigned char i2c_start_wait(unsigned char address)
 {
     uint8_t   twst;
+    uint8_t   retries;
 
-	USART_Send_string("\nBefore while(1)\n");
-	
-    while ( 1 )
+    for ( retries = 0; retries < I2C_START_RETRIES; retries++ )
     {
-		USART_Send_int(TWSR);
-		USART_Send_string("\n");
 	    // send START condition
 	    TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
-		USART_Send_string("\nAfter Setting TWCR\n");
-		
-		USART_Send_int(TWSR);
-		USART_Send_string("\n");
     
     	// wait until transmission completed
-    	while(!(TWCR & (1<<TWINT))){_delay_ms(100); USART_Send_int(TWSR); USART_Send_string("\n");};
-		USART_Send_string("\nAfter waiting for transmission complete\n");
+    	if ( i2c_wait() ) continue;
     
     	// check value of TWI Status Register. Mask prescaler bits.
     	twst = TW_STATUS & 0xF8;
     	if ( (twst != TW_START) && (twst != TW_REP_START)) continue;
-		USART_Send_string("\nAfter checking TWI Status Register\n");
     
     	// send device address
     	TWDR = address;
     	TWCR = (1<<TWINT) | (1<<TWEN);
-		USART_Send_string("\nAfter sending device address\n");
     
     	// wail until transmission completed
-    	while(!(TWCR & (1<<TWINT)));
-		USART_Send_string("\nAfter waiting for transmission complete\n");
+    	if ( i2c_wait() ) continue;
 		
     	// check value of TWI Status Register. Mask prescaler bits.
     	twst = TW_STATUS & 0xF8;
     	if ( (twst == TW_MT_SLA_NACK )||(twst ==TW_MR_DATA_NACK) ) 
-    	{   
-			USART_Send_string("\nDevice busy, send stop condition to terminate write\n");	    
+    	{    	    
     	    /* device busy, send stop condition to terminate write operation */
-	        TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
-	        
-	        // wait until stop condition is executed and bus released
-	        while(TWCR & (1<<TWSTO));
-			USART_Send_string("\nAfter waiting until stop condition is executed and bus is released\n");
-	        
+	        i2c_stop();
     	    continue;
     	}
-    	//if( twst != TW_MT_SLA_ACK) return 1;
 		
-		USART_Send_string("\n___OUT___\n");
-    	break;
+    	return 0;
      }
 
+    return 1;
+
 }/* i2c_start_wait */
 
 
@@ -154,11 +287,21 @@ unsigned char i2c_rep_start(unsigned char address)
 *************************************************************************/
 void i2c_stop(void)
 {
+    uint16_t us;
+
     /* send stop condition */
 	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
 	
 	// wait until stop condition is executed and bus released
-	while(TWCR & (1<<TWSTO));
+	for (us = 0; TWCR & (1<<TWSTO); us++)
+	{
+		if (us >= I2C_TIMEOUT_US)
+		{
+			i2c_recover();
+			break;
+		}
+		_delay_us(1);
+	}
 
 }/* i2c_stop */
 
@@ -179,7 +322,7 @@ unsigned char i2c_write( unsigned char data )
 	TWCR = (1<<TWINT) | (1<<TWEN);
 
 	// wait until transmission completed
-	while(!(TWCR & (1<<TWINT)));
+	if (i2c_wait()) return 1;
 
 	// check value of TWI Status Register. Mask prescaler bits
 	twst = TW_STATUS & 0xF8;
@@ -197,7 +340,7 @@ unsigned char i2c_write( unsigned char data )
 unsigned char i2c_readAck(void)
 {
 	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA);
-	while(!(TWCR & (1<<TWINT)));    
+	i2c_wait();
 
     return TWDR;
 
@@ -212,7 +355,7 @@ unsigned char i2c_readAck(void)
 unsigned char i2c_readNak(void)
 {
 	TWCR = (1<<TWINT) | (1<<TWEN);
-	while(!(TWCR & (1<<TWINT)));
+	i2c_wait();
 	
     return TWDR;
 
@@ -0,0 +1,410 @@
+/*************************************************************************
+* Title:    Interrupt driven I2C master with a transaction queue
+* File:     twiqueue.c
+* Software: AVR-GCC 3.4.2
+* Target:   any AVR device with hardware TWI
+* Usage:    see twiqueue.h
+**************************************************************************/
+#include <stddef.h>
+#include <inttypes.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <compat/twi.h>
+
+#include "i2cmaster.h"
+#include "twiqueue.h"
+
+#define TWI_BUFFER_MASK  (TWI_BUFFER_LEN - 1)
+
+#if (TWI_BUFFER_LEN & TWI_BUFFER_MASK) || (TWI_BUFFER_LEN > 128)
+#error "TWI_BUFFER_LEN must be a power of two no larger than 128"
+#endif
+
+/* TWCR values: keep the interrupt enabled and clear TWINT to go on */
+#define TWCR_NEXT   ((1<<TWINT) | (1<<TWEN) | (1<<TWIE))
+#define TWCR_START  (TWCR_NEXT | (1<<TWSTA))
+
+/* header address of a queued pause (a read address, never a write) */
+#define TWI_PAUSE   0xFF
+
+
+/*
+ Each transaction sits in the ring as [address][length][data ...], and a
+ pause as [TWI_PAUSE][ticks].
+ Head only moves once a whole transaction is in place, so TWI_vect never
+ sees half of one; Tail moves as soon as a byte is handed to TWDR.
+*/
+static uint8_t twi_buffer[TWI_BUFFER_LEN];
+
+static volatile uint8_t twi_head;       /* end of the queued transactions */
+static volatile uint8_t twi_tail;       /* next byte to send */
+static volatile uint8_t twi_running;    /* TWI_vect owns the bus */
+static volatile uint8_t twi_last_error; /* last failure, TWI_OK if none */
+static volatile uint8_t twi_ticks;      /* twi_tick() calls since the last bus event */
+static volatile uint8_t twi_pause_ticks;/* twi_tick() calls left in the pause */
+
+static twi_callback_t twi_callback;
+
+/* transaction being built by the main program */
+static uint8_t twi_build_start;
+static uint8_t twi_build_head;
+static uint8_t twi_build_length;
+static uint8_t twi_build_failed;
+
+/* transaction being sent by TWI_vect */
+static uint8_t twi_address;
+static uint8_t twi_remaining;
+static uint8_t twi_sending;             /* header taken from the ring */
+
+
+/*************************************************************************
+ Initialization of the TWI and the queue. Need to be called only once
+*************************************************************************/
+void twi_init(void)
+{
+    i2c_init();
+
+    twi_head = 0;
+    twi_tail = 0;
+    twi_running = 0;
+    twi_last_error = TWI_OK;
+    twi_ticks = 0;
+    twi_pause_ticks = 0;
+    twi_sending = 0;
+    twi_callback = NULL;
+
+}/* twi_init */
+
+
+/*************************************************************************
+ Set the function called as each transaction completes
+*************************************************************************/
+void twi_set_callback(twi_callback_t callback)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        twi_callback = callback;
+    }
+
+}/* twi_set_callback */
+
+
+/*************************************************************************
+ Start the transaction at the tail, or the pause in front of it
+ (interrupts off; control is TWSTO to end the transaction before, or 0)
+*************************************************************************/
+static void twi_start(uint8_t control)
+{
+    uint8_t tail = twi_tail;
+
+    if (tail == twi_head)
+    {
+        TWCR = (1<<TWINT) | (1<<TWEN) | control;
+        twi_running = 0;
+    }
+    else if (twi_buffer[tail] == TWI_PAUSE)
+    {
+        // release the bus and let twi_tick() count the pause down
+        twi_pause_ticks = twi_buffer[(tail + 1) & TWI_BUFFER_MASK];
+        twi_tail = (tail + 2) & TWI_BUFFER_MASK;
+
+        TWCR = (1<<TWINT) | (1<<TWEN) | control;
+    }
+    else
+    {
+        // START as soon as the bus is free (after the STOP, if any)
+        TWCR = TWCR_START | control;
+    }
+
+}/* twi_start */
+
+
+/*************************************************************************
+ Start building a write transaction
+
+ Return:  TWI_OK, or TWI_QUEUE_FULL if the header does not fit
+*************************************************************************/
+uint8_t twi_begin(uint8_t address)
+{
+    if (twi_free() < 2) return TWI_QUEUE_FULL;
+
+    twi_build_start = twi_head;
+    twi_build_head = (twi_build_start + 2) & TWI_BUFFER_MASK;
+    twi_build_length = 0;
+    twi_build_failed = 0;
+
+    twi_buffer[twi_build_start] = address;
+
+    return TWI_OK;
+
+}/* twi_begin */
+
+
+/*************************************************************************
+ Add a byte to the transaction being built
+
+ Return:  TWI_OK, or TWI_QUEUE_FULL if the byte does not fit
+*************************************************************************/
+uint8_t twi_put(uint8_t data)
+{
+    if (twi_build_failed) return TWI_QUEUE_FULL;
+
+    // one slot always stays empty to tell a full ring from an empty one
+    if (((twi_build_head + 1) & TWI_BUFFER_MASK) == twi_tail)
+    {
+        twi_build_failed = 1;
+        return TWI_QUEUE_FULL;
+    }
+
+    twi_buffer[twi_build_head] = data;
+    twi_build_head = (twi_build_head + 1) & TWI_BUFFER_MASK;
+    twi_build_length++;
+
+    return TWI_OK;
+
+}/* twi_put */
+
+
+/*************************************************************************
+ Queue the transaction being built and start the bus if it is idle
+
+ Return:  TWI_OK, or TWI_QUEUE_FULL if it was dropped
+*************************************************************************/
+uint8_t twi_end(void)
+{
+    if (twi_build_failed) return TWI_QUEUE_FULL;
+
+    twi_buffer[(twi_build_start + 1) & TWI_BUFFER_MASK] = twi_build_length;
+
+    // publish and check for an idle bus together, or TWI_vect could go
+    // idle in between and leave the transaction waiting
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        twi_head = twi_build_head;
+
+        if (!twi_running)
+        {
+            twi_running = 1;
+            twi_ticks = 0;
+            twi_start(0);
+        }
+    }
+
+    return TWI_OK;
+
+}/* twi_end */
+
+
+/*************************************************************************
+ Queue a pause: the next transaction starts no sooner than the given
+ number of twi_tick() calls after everything before it was sent
+
+ Return:  TWI_OK, or TWI_QUEUE_FULL if nothing was queued
+*************************************************************************/
+uint8_t twi_pause(uint8_t ticks)
+{
+    if (ticks == 0) return TWI_OK;
+
+    if (twi_begin(TWI_PAUSE) != TWI_OK) return TWI_QUEUE_FULL;
+
+    // the length field holds the ticks, no data follows
+    twi_build_length = ticks;
+
+    return twi_end();
+
+}/* twi_pause */
+
+
+/*************************************************************************
+ Queue a whole write transaction
+
+ Return:  TWI_OK, or TWI_QUEUE_FULL if nothing was queued
+*************************************************************************/
+uint8_t twi_write(uint8_t address, const uint8_t *data, uint8_t length)
+{
+    if (twi_free() < length + 2) return TWI_QUEUE_FULL;
+
+    twi_begin(address);
+
+    while (length--)
+    {
+        twi_put(*data++);
+    }
+
+    return twi_end();
+
+}/* twi_write */
+
+
+/*************************************************************************
+ Number of bytes that can still be queued
+*************************************************************************/
+uint8_t twi_free(void)
+{
+    return TWI_BUFFER_MASK - ((twi_head - twi_tail) & TWI_BUFFER_MASK);
+
+}/* twi_free */
+
+
+/*************************************************************************
+ Check if transactions are queued or being sent
+*************************************************************************/
+uint8_t twi_busy(void)
+{
+    return twi_running;
+
+}/* twi_busy */
+
+
+/*************************************************************************
+ Status of the last failed transaction, cleared by the read
+*************************************************************************/
+uint8_t twi_error(void)
+{
+    uint8_t error;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        error = twi_last_error;
+        twi_last_error = TWI_OK;
+    }
+
+    return error;
+
+}/* twi_error */
+
+
+/*************************************************************************
+ Drop what is left of the transaction being sent and report it
+*************************************************************************/
+static void twi_complete(uint8_t status)
+{
+    // skip whatever a failed transaction had left to send
+    twi_tail = (twi_tail + twi_remaining) & TWI_BUFFER_MASK;
+    twi_remaining = 0;
+    twi_sending = 0;
+
+    if (status != TWI_OK) twi_last_error = status;
+
+    if (twi_callback) twi_callback(twi_address, status);
+
+}/* twi_complete */
+
+
+/*************************************************************************
+ Finish the transaction being sent and start the next one (TWI_vect only)
+*************************************************************************/
+static void twi_next(uint8_t status)
+{
+    uint8_t control;
+
+    // after a lost arbitration the bus is not ours to STOP
+    control = (status == TWI_ARB_LOST) ? 0 : (1<<TWSTO);
+
+    twi_complete(status);
+    twi_start(control);
+
+}/* twi_next */
+
+
+/*************************************************************************
+ Count down a pause and watch the bus for a timeout (call every
+ millisecond)
+
+ A slave holding SDA low, or a glitch the TWI never recovers from, stops
+ TWI_vect from firing at all. After TWI_TIMEOUT_TICKS calls without a bus
+ event the bus is recovered and the transaction in progress is dropped.
+*************************************************************************/
+void twi_tick(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (!twi_running) return;
+
+        if (twi_pause_ticks)
+        {
+            if (--twi_pause_ticks == 0)
+            {
+                twi_ticks = 0;
+                twi_start(0);
+            }
+            return;
+        }
+
+        if (++twi_ticks < TWI_TIMEOUT_TICKS) return;
+
+        twi_ticks = 0;
+
+        // a START never granted leaves the header in the ring
+        if (!twi_sending)
+        {
+            twi_address = twi_buffer[twi_tail];
+            twi_remaining = twi_buffer[(twi_tail + 1) & TWI_BUFFER_MASK];
+            twi_tail = (twi_tail + 2) & TWI_BUFFER_MASK;
+        }
+
+        i2c_recover();
+        twi_complete(TWI_TIMEOUT);
+        twi_start(0);
+    }
+
+}/* twi_tick */
+
+
+/*************************************************************************
+ TWI interrupt: one bus event per call, never waits
+*************************************************************************/
+ISR(TWI_vect)
+{
+    uint8_t tail = twi_tail;
+
+    twi_ticks = 0;
+
+    switch (TW_STATUS)
+    {
+        case TW_START:
+        case TW_REP_START:
+            twi_address = twi_buffer[tail];
+            twi_remaining = twi_buffer[(tail + 1) & TWI_BUFFER_MASK];
+            twi_tail = (tail + 2) & TWI_BUFFER_MASK;
+            twi_sending = 1;
+
+            TWDR = twi_address;
+            TWCR = TWCR_NEXT;
+            break;
+
+        case TW_MT_SLA_ACK:
+        case TW_MT_DATA_ACK:
+            if (twi_remaining)
+            {
+                TWDR = twi_buffer[tail];
+                twi_tail = (tail + 1) & TWI_BUFFER_MASK;
+                twi_remaining--;
+
+                TWCR = TWCR_NEXT;
+            }
+            else
+            {
+                twi_next(TWI_OK);
+            }
+            break;
+
+        case TW_MT_SLA_NACK:
+            twi_next(TWI_NO_DEVICE);
+            break;
+
+        case TW_MT_DATA_NACK:
+            twi_next(TWI_DATA_NACK);
+            break;
+
+        case TW_MT_ARB_LOST:
+            twi_next(TWI_ARB_LOST);
+            break;
+
+        default:
+            // TW_BUS_ERROR; TWSTO releases the lines without a STOP
+            twi_next(TWI_BUS_ERROR);
+            break;
+    }
+
+}/* ISR(TWI_vect) */
@@ -0,0 +1,187 @@
+#ifndef _TWIQUEUE_H
+#define _TWIQUEUE_H   1
+/*************************************************************************
+* Title:    C include file for the interrupt driven I2C master queue
+*           (twiqueue.c)
+* File:     twiqueue.h
+* Software: AVR-GCC 3.4.2
+* Target:   any AVR device with hardware TWI
+* Usage:    see below
+**************************************************************************/
+
+/**
+ @defgroup twiqueue Interrupt driven I2C master
+ @code #include "twiqueue.h" @endcode
+
+ @brief Queued I2C (TWI) write transactions, sent from TWI_vect
+
+ Write transactions are copied into a ring buffer and the TWI interrupt
+ sends them one after another in the background, so a caller never waits
+ on the bus. A transaction is either queued whole or not at all; if the
+ buffer has no room the caller gets TWI_QUEUE_FULL and decides what to
+ drop. A device that does not answer fails its transaction and the queue
+ moves on to the next one.
+
+ The ring is single producer (main program) and single consumer
+ (TWI_vect): transactions must not be queued from an interrupt.
+
+ The bus is watched by twi_tick(), called every millisecond from a timer
+ interrupt. If the TWI shows no progress for TWI_TIMEOUT_TICKS calls the
+ bus is recovered with i2c_recover(), the transaction in progress fails
+ with TWI_TIMEOUT and the queue goes on.
+
+ The blocking i2cmaster.h functions share the TWI hardware and may only be
+ used while twi_busy() is false.
+
+ Only this test project uses the queue so far. The sorter
+ (Final_Project_CPP) still drives its LCD with the Arduino
+ LiquidCrystal_I2C and Wire libraries. Wire has its own TWI_vect, so the
+ two cannot be linked together; moving the sorter over means replacing
+ LiquidCrystal_I2C.
+
+ @par Usage Example
+ @code
+ twi_init();
+ i2c_probe_speed(0x4E);
+ sei();
+
+ // one byte
+ twi_write(0x4E, &value, 1);
+
+ // many bytes streamed between one START and STOP
+ if (twi_begin(0x4E) == TWI_OK)
+ {
+     twi_put(first);
+     twi_put(second);
+     twi_end();
+ }
+ @endcode
+*/
+
+/**@{*/
+
+#include <stdint.h>
+
+/** ring buffer size in bytes (power of two, at most 128); each transaction
+    takes two bytes of header plus its data */
+#ifndef TWI_BUFFER_LEN
+#define TWI_BUFFER_LEN  128
+#endif
+
+/** twi_tick() calls without bus progress before the bus is taken as stuck */
+#ifndef TWI_TIMEOUT_TICKS
+#define TWI_TIMEOUT_TICKS  10
+#endif
+
+/** @name Status codes */
+/**@{*/
+#define TWI_OK          0   /**< transaction queued or sent */
+#define TWI_QUEUE_FULL  1   /**< not enough room in the ring buffer, nothing queued */
+#define TWI_NO_DEVICE   2   /**< address not acknowledged */
+#define TWI_DATA_NACK   3   /**< data byte not acknowledged */
+#define TWI_ARB_LOST    4   /**< arbitration lost */
+#define TWI_BUS_ERROR   5   /**< illegal START or STOP on the bus */
+#define TWI_TIMEOUT     6   /**< bus stuck, recovered with i2c_recover() */
+/**@}*/
+
+/** transaction completion callback: address (with R/W bit) and status,
+    called from TWI_vect */
+typedef void (*twi_callback_t)(uint8_t address, uint8_t status);
+
+
+/**
+ @brief initialize the TWI and the queue. Need to be called only once
+ @return none
+ */
+extern void twi_init(void);
+
+
+/**
+ @brief set a function called from TWI_vect as each transaction completes
+ @param  callback function to call, or NULL for none
+ @return none
+ */
+extern void twi_set_callback(twi_callback_t callback);
+
+
+/**
+ @brief start building a write transaction
+ @param  address address and transfer direction (I2C_WRITE) of I2C device
+ @retval TWI_OK         transaction started, add data with twi_put()
+ @retval TWI_QUEUE_FULL no room for the transaction header
+ */
+extern uint8_t twi_begin(uint8_t address);
+
+
+/**
+ @brief add a byte to the transaction being built
+ @param  data byte to be transfered
+ @retval TWI_OK         byte added
+ @retval TWI_QUEUE_FULL no room, twi_end() will drop the transaction
+ */
+extern uint8_t twi_put(uint8_t data);
+
+
+/**
+ @brief queue the transaction being built and start the bus if idle
+ @retval TWI_OK         transaction queued
+ @retval TWI_QUEUE_FULL some byte did not fit, nothing queued
+ */
+extern uint8_t twi_end(void);
+
+
+/**
+ @brief queue a whole write transaction
+ @param  address address and transfer direction (I2C_WRITE) of I2C device
+ @param  data bytes to be transfered
+ @param  length number of bytes
+ @retval TWI_OK         transaction queued
+ @retval TWI_QUEUE_FULL no room, nothing queued
+ */
+extern uint8_t twi_write(uint8_t address, const uint8_t *data, uint8_t length);
+
+
+/**
+ @brief queue a pause between two transactions
+
+ Lets a device finish a slow command without the caller waiting: the
+ transaction queued after the pause starts no sooner than ticks twi_tick()
+ calls after everything queued before it was sent. A pause takes two bytes
+ of the ring buffer.
+ @param  ticks twi_tick() calls to wait, 0 for none
+ @retval TWI_OK         pause queued
+ @retval TWI_QUEUE_FULL no room, nothing queued
+ */
+extern uint8_t twi_pause(uint8_t ticks);
+
+
+/**
+ @brief number of bytes that can still be queued (header included)
+ */
+extern uint8_t twi_free(void);
+
+
+/**
+ @brief check if transactions or pauses are queued or being sent
+ @retval 0 bus idle and queue empty
+ @retval 1 busy
+ */
+extern uint8_t twi_busy(void);
+
+
+/**
+ @brief count down pauses and watch the bus for a timeout (call every millisecond)
+ @return none
+ */
+extern void twi_tick(void);
+
+
+/**
+ @brief status of the last transaction that failed, cleared by the read
+ @return TWI_OK if none failed since the last call
+ */
+extern uint8_t twi_error(void);
+
+
+/**@}*/
+#endif